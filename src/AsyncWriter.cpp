@@ -0,0 +1,443 @@
+#include "AsyncWriter.h"
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(_WIN32)
+typedef HANDLE FileHandle;
+#else
+typedef int FileHandle;
+#endif
+
+// positional write of the whole range
+static bool writeFully(FileHandle file, const unsigned char* data, size_t size, unsigned long long offset)
+{
+	while (size > 0)
+	{
+#if defined(_WIN32)
+		OVERLAPPED position;
+		memset(&position, 0, sizeof(position));
+		position.Offset = (DWORD)offset;
+		position.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD written = 0;
+		if (!WriteFile(file, data, (DWORD)size, &written, &position) || written == 0)
+			return false;
+#else
+		ssize_t written = pwrite(file, data, size, (off_t)offset);
+		if (written <= 0)
+			return false;
+#endif
+		data += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+static unsigned char* allocateAligned(size_t size, size_t alignment)
+{
+#if defined(_WIN32)
+	return (unsigned char*)_aligned_malloc(size, alignment);
+#else
+	void* p = 0;
+	if (posix_memalign(&p, alignment, size) != 0)
+		return 0;
+	return (unsigned char*)p;
+#endif
+}
+
+static void freeAligned(unsigned char* p)
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+
+AsyncWriter::AsyncWriter(bool direct)
+{
+	m_direct = direct;
+#if defined(_WIN32)
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	m_file = -1;
+#endif
+#if defined(HAVE_LIBURING)
+	m_useRing = false;
+#endif
+	m_size = 0;
+	m_current = -1;
+	m_inFlight = 0;
+	m_stopping = false;
+	m_writes = m_stalls = m_stallTimeUs = m_errors = 0;
+	m_maxInFlight = 0;
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	close();
+}
+
+bool AsyncWriter::open(const string& fileName)
+{
+	m_fileName = fileName;
+
+#if defined(_WIN32)
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | (m_direct ? FILE_FLAG_NO_BUFFERING : 0);
+	m_file = CreateFileA(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, flags, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+	if (m_direct)
+		flags |= O_DIRECT;
+#endif
+	m_file = ::open(fileName.c_str(), flags, 0644);
+	if (m_file < 0 && m_direct)
+	{
+		// e.g. tmpfs does not support O_DIRECT
+		cerr << "Warning: O_DIRECT is not supported for " << fileName << ", using buffered writes" << endl;
+		m_direct = false;
+		m_file = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (m_file < 0)
+		return false;
+#endif
+
+	m_buffers.resize(NUM_BUFFERS);
+	m_free.clear();
+	for (int i = 0; i < NUM_BUFFERS; i++)
+	{
+		m_buffers[i].data = allocateAligned(BUFFER_SIZE, ALIGNMENT);
+		m_buffers[i].used = m_buffers[i].submitted = 0;
+		m_buffers[i].offset = 0;
+		m_free.push_back(i);
+	}
+
+	m_current = takeFreeBuffer();
+	m_buffers[m_current].offset = 0;
+	m_size = 0;
+
+#if defined(HAVE_LIBURING)
+	m_useRing = (io_uring_queue_init(NUM_BUFFERS, &m_ring, 0) == 0);
+	if (m_useRing)
+		return true;
+#endif
+
+	m_stopping = false;
+	for (int i = 0; i < NUM_WORKERS; i++)
+		m_workers.push_back(thread(&AsyncWriter::workerLoop, this));
+
+	return true;
+}
+
+void AsyncWriter::close()
+{
+	if (m_buffers.empty())
+		return;
+
+	// write what is left (padded to whole pages in direct mode) and wait for everything
+	if (m_buffers[m_current].used > 0)
+		submitCurrent(true);
+	while (m_inFlight > 0)
+		reap(true);
+
+#if defined(HAVE_LIBURING)
+	if (m_useRing)
+		io_uring_queue_exit(&m_ring);
+#endif
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_work.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+	m_workers.clear();
+
+	for (size_t i = 0; i < m_buffers.size(); i++)
+		freeAligned(m_buffers[i].data);
+	m_buffers.clear();
+
+	// cut the padding and apply the header patches through a normal (buffered) handle
+#if defined(_WIN32)
+	CloseHandle(m_file);
+	m_file = CreateFileA(m_fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		size.QuadPart = m_size;
+		SetFilePointerEx(m_file, size, NULL, FILE_BEGIN);
+		SetEndOfFile(m_file);
+		for (size_t i = 0; i < m_patches.size(); i++)
+			writeFully(m_file, &m_patches[i].data[0], m_patches[i].data.size(), m_patches[i].offset);
+		CloseHandle(m_file);
+	}
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	::close(m_file);
+	m_file = ::open(m_fileName.c_str(), O_WRONLY);
+	if (m_file >= 0)
+	{
+		if (ftruncate(m_file, (off_t)m_size) != 0)
+			perror("AsyncWriter: ftruncate");
+		for (size_t i = 0; i < m_patches.size(); i++)
+			writeFully(m_file, &m_patches[i].data[0], m_patches[i].data.size(), m_patches[i].offset);
+		::close(m_file);
+	}
+	m_file = -1;
+#endif
+	m_patches.clear();
+}
+
+unsigned char* AsyncWriter::reserve(size_t maxSize)
+{
+	// a block has to fit in one buffer (plus a carried-over partial page)
+	if (maxSize + ALIGNMENT > BUFFER_SIZE)
+		return 0;
+
+	Buffer& current = m_buffers[m_current];
+	if (current.used + maxSize > BUFFER_SIZE)
+	{
+		if (!submitCurrent(false))
+			return 0;
+	}
+
+	return m_buffers[m_current].data + m_buffers[m_current].used;
+}
+
+bool AsyncWriter::commit(size_t size)
+{
+	m_buffers[m_current].used += size;
+	m_size += size;
+	return true;
+}
+
+bool AsyncWriter::writeAt(unsigned long long offset, const unsigned char* data, size_t size)
+{
+	if (offset + size > m_size)
+		return false;
+
+	Patch patch;
+	patch.offset = offset;
+	patch.data.assign(data, data + size);
+	m_patches.push_back(patch);
+	return true;
+}
+
+void AsyncWriter::sync()
+{
+	// in direct mode only whole pages can be submitted before the end
+	size_t minimum = m_direct ? ALIGNMENT : 1;
+	if (m_buffers[m_current].used >= minimum)
+		submitCurrent(false);
+
+	reap(false);
+}
+
+string AsyncWriter::getStatistics()
+{
+	string s = "async writer (";
+#if defined(HAVE_LIBURING)
+	s += m_useRing ? "io_uring" : "thread pool";
+#else
+	s += "thread pool";
+#endif
+	s += m_direct ? ", direct): " : "): ";
+	s += to_string(m_writes) + " writes, at most " + to_string(m_maxInFlight) + " of " + to_string((int)NUM_BUFFERS) + " in flight, ";
+	s += to_string(m_stalls) + " backpressure stall(s) (" + to_string(m_stallTimeUs / 1000.0) + " ms)";
+	if (m_errors > 0)
+		s += ", " + to_string(m_errors) + " failed write(s)";
+	return s;
+}
+
+bool AsyncWriter::submitCurrent(bool last)
+{
+	Buffer& current = m_buffers[m_current];
+
+	size_t bytes = current.used;
+	size_t carry = 0;
+
+	if (m_direct)
+	{
+		if (last)
+		{
+			// pad to a whole page; close() truncates the file to the real size
+			bytes = (current.used + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+			memset(current.data + current.used, 0, bytes - current.used);
+		}
+		else
+		{
+			bytes = current.used / ALIGNMENT * ALIGNMENT;
+			carry = current.used - bytes;
+		}
+	}
+
+	if (last)
+	{
+		current.submitted = bytes;
+		submit(m_current);
+		return true;
+	}
+
+	int next = takeFreeBuffer();
+	if (next < 0)
+		return false;
+
+	// the partial page goes to the start of the next buffer
+	Buffer& following = m_buffers[next];
+	memcpy(following.data, current.data + bytes, carry);
+	following.used = carry;
+	following.offset = current.offset + bytes;
+
+	if (bytes > 0)
+	{
+		current.submitted = bytes;
+		submit(m_current);
+	}
+	else
+	{
+		m_free.push_back(m_current);
+	}
+
+	m_current = next;
+	return true;
+}
+
+int AsyncWriter::takeFreeBuffer()
+{
+	reap(false);
+
+	if (m_free.empty())
+	{
+		// every buffer is in flight: this is backpressure from the disk
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		m_stalls++;
+		while (m_free.empty() && m_inFlight > 0)
+			reap(true);
+		m_stallTimeUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	}
+
+	if (m_free.empty())
+		return -1;
+
+	int index = m_free.back();
+	m_free.pop_back();
+	return index;
+}
+
+void AsyncWriter::submit(int index)
+{
+	m_inFlight++;
+	m_writes++;
+	if (m_inFlight > m_maxInFlight)
+		m_maxInFlight = m_inFlight;
+
+#if defined(HAVE_LIBURING)
+	if (m_useRing)
+	{
+		Buffer& buffer = m_buffers[index];
+		struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+		io_uring_prep_write(sqe, m_file, buffer.data, (unsigned int)buffer.submitted, buffer.offset);
+		io_uring_sqe_set_data(sqe, (void*)(intptr_t)index);
+		io_uring_submit(&m_ring);
+		return;
+	}
+#endif
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_queue.push_back(index);
+	}
+	m_work.notify_one();
+}
+
+void AsyncWriter::reap(bool wait)
+{
+	if (m_inFlight == 0)
+		return;
+
+#if defined(HAVE_LIBURING)
+	if (m_useRing)
+	{
+		struct io_uring_cqe* cqe;
+		int result = wait ? io_uring_wait_cqe(&m_ring, &cqe) : io_uring_peek_cqe(&m_ring, &cqe);
+
+		while (result == 0 && cqe != 0)
+		{
+			int index = (int)(intptr_t)io_uring_cqe_get_data(cqe);
+			Buffer& buffer = m_buffers[index];
+			bool ok = (cqe->res == (int)buffer.submitted);
+
+			// finish a short write synchronously
+			if (!ok && cqe->res > 0)
+				ok = writeFully(m_file, buffer.data + cqe->res, buffer.submitted - cqe->res, buffer.offset + cqe->res);
+
+			io_uring_cqe_seen(&m_ring, cqe);
+			completed(index, ok);
+
+			result = io_uring_peek_cqe(&m_ring, &cqe);
+		}
+		return;
+	}
+#endif
+
+	deque<pair<int, bool> > done;
+	{
+		unique_lock<mutex> lock(m_mutex);
+		if (wait)
+			m_done.wait(lock, [this] { return !m_completed.empty(); });
+		done.swap(m_completed);
+	}
+
+	for (size_t i = 0; i < done.size(); i++)
+		completed(done[i].first, done[i].second);
+}
+
+void AsyncWriter::completed(int index, bool ok)
+{
+	if (!ok)
+	{
+		m_errors++;
+		cerr << "Error: Asynchronous write of " << m_buffers[index].submitted << " bytes failed!" << endl;
+	}
+
+	m_buffers[index].used = m_buffers[index].submitted = 0;
+	m_free.push_back(index);
+	m_inFlight--;
+}
+
+void AsyncWriter::workerLoop()
+{
+	while (true)
+	{
+		int index;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_work.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty())
+				return;
+			index = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		Buffer& buffer = m_buffers[index];
+		bool ok = writeFully(m_file, buffer.data, buffer.submitted, buffer.offset);
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_completed.push_back(make_pair(index, ok));
+		}
+		m_done.notify_one();
+	}
+}
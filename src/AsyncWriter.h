@@ -0,0 +1,108 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "LogWriter.h"
+
+#if defined(HAVE_LIBURING)
+#include <liburing.h>
+#endif
+
+using namespace std;
+
+// Asynchronous backend.  Blocks are encoded into a fixed set of aligned
+// buffers; a full buffer is submitted as one positional write and the
+// flushing thread carries on with the next free buffer.  Writes go
+// through io_uring when the program is built with HAVE_LIBURING (and
+// the kernel supports it), otherwise through a small pool of threads
+// calling pwrite (WriteFile on Windows).
+//
+// At most NUM_BUFFERS writes are in flight.  When all buffers are busy
+// the flushing thread waits for a completion; these stalls are counted
+// so that a slow disk shows up as backpressure in the statistics (and
+// as dropped samples of the bounded ring), never as unbounded buffering.
+//
+// In direct mode the file is opened with O_DIRECT (FILE_FLAG_NO_BUFFERING)
+// and only whole, aligned pages are submitted; the partial page at the
+// end of a buffer is carried over to the next one.  writeAt() patches are
+// applied in close(), once all writes have completed.
+class AsyncWriter : public LogWriter
+{
+public:
+	enum { BUFFER_SIZE = 512 * 1024, NUM_BUFFERS = 8, NUM_WORKERS = 2, ALIGNMENT = 4096 };
+
+public:
+	AsyncWriter(bool direct);
+	~AsyncWriter();
+
+public:
+	bool open(const string& fileName);
+	void close();
+	unsigned char* reserve(size_t maxSize);
+	bool commit(size_t size);
+	bool writeAt(unsigned long long offset, const unsigned char* data, size_t size);
+	void sync();
+	string getStatistics();
+
+private:
+	struct Buffer
+	{
+		unsigned char* data;
+		size_t used;					// bytes encoded into the buffer
+		size_t submitted;				// bytes handed to the write
+		unsigned long long offset;		// file offset of data[0]
+	};
+
+	struct Patch
+	{
+		unsigned long long offset;
+		vector<unsigned char> data;
+	};
+
+	bool submitCurrent(bool last);
+	int takeFreeBuffer();
+	void submit(int index);
+	void reap(bool wait);
+	void completed(int index, bool ok);
+	void workerLoop();
+
+private:
+	bool m_direct;
+	string m_fileName;
+#if defined(_WIN32)
+	HANDLE m_file;
+#else
+	int m_file;
+#endif
+
+	vector<Buffer> m_buffers;
+	vector<int> m_free;
+	int m_current;
+	int m_inFlight;
+
+#if defined(HAVE_LIBURING)
+	struct io_uring m_ring;
+	bool m_useRing;
+#endif
+
+	// fallback thread pool
+	vector<thread> m_workers;
+	mutex m_mutex;
+	condition_variable m_work;
+	condition_variable m_done;
+	deque<int> m_queue;
+	deque<pair<int, bool> > m_completed;
+	bool m_stopping;
+
+	vector<Patch> m_patches;
+
+	// statistics
+	unsigned long long m_writes;
+	unsigned long long m_stalls;		// reservations that had to wait for a free buffer
+	unsigned long long m_stallTimeUs;
+	unsigned long long m_errors;
+	int m_maxInFlight;
+};
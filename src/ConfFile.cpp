@@ -1,4 +1,5 @@
 #include "ConfFile.h"
+#include "HdataFormat.h"
 
 
 ConfFile::ConfFile()
@@ -100,6 +101,169 @@ void ConfFile::parseCommand(vector<string> &parsedLine)
 				}
 			}
 		}
+		else if (parsedLine[0] == "FLUSH")
+		{
+			if (parsedLine.size() != 2)
+				cerr << "Error: Wrong flush latency input in the configuration file!";
+			else
+				m_flushLatency = stod(parsedLine[1]) / 1000.0;
+		}
+		else if (parsedLine[0] == "FORMAT")
+		{
+			if (parsedLine.size() != 2 || (parsedLine[1] != "FLOAT" && parsedLine[1] != "DOUBLE" && parsedLine[1] != "DELTA"))
+				cerr << "Error: Wrong data format in the configuration file!";
+			else
+			{
+				m_logFloat32 = (parsedLine[1] == "FLOAT");
+				m_logDelta = (parsedLine[1] == "DELTA");
+			}
+		}
+		else if (parsedLine[0] == "PRECISION")
+		{
+			if (parsedLine.size() != 2 || stod(parsedLine[1]) < 0.0)
+				cerr << "Error: Wrong precision input in the configuration file!";
+			else
+				m_logPrecision = stod(parsedLine[1]);
+		}
+		else if (parsedLine[0] == "WRITER")
+		{
+			if (parsedLine.size() != 2 || (parsedLine[1] != "STDIO" && parsedLine[1] != "MMAP" && parsedLine[1] != "ASYNC" && parsedLine[1] != "DIRECT"))
+				cerr << "Error: Wrong data writer in the configuration file!";
+			else
+				m_logWriter = parsedLine[1];
+		}
+		else if (parsedLine[0] == "LOGPOLICY")
+		{
+			if (parsedLine.size() != 2 || (parsedLine[1] != "FULL" && parsedLine[1] != "ADAPTIVE"))
+				cerr << "Error: Wrong logging policy in the configuration file!";
+			else
+				m_logAdaptive = (parsedLine[1] == "ADAPTIVE");
+		}
+		else if (parsedLine[0] == "IDLERATE")
+		{
+			if (parsedLine.size() != 2 || stod(parsedLine[1]) < 0.0)
+				cerr << "Error: Wrong idle logging rate in the configuration file!";
+			else
+				m_logIdleRate = stod(parsedLine[1]);
+		}
+		else if (parsedLine[0] == "THRESHOLD")
+		{
+			if (parsedLine.size() != 3 || stod(parsedLine[1]) < 0.0 || stod(parsedLine[2]) < 0.0)
+				cerr << "Error: Wrong logging threshold input in the configuration file!";
+			else
+			{
+				m_logPosThreshold = stod(parsedLine[1]);
+				m_logAngleThreshold = stod(parsedLine[2]) * DEG2RAD;
+			}
+		}
+		else if (parsedLine[0] == "HAPTICRATE")
+		{
+			if (parsedLine.size() != 2 || stod(parsedLine[1]) < 0.0)
+				cerr << "Error: Wrong haptic rate in the configuration file!";
+			else
+				m_hapticRate = stod(parsedLine[1]);
+		}
+		else if (parsedLine[0] == "WAIT")
+		{
+			if (parsedLine.size() < 2 || parsedLine.size() > 3 || (parsedLine[1] != "SLEEP" && parsedLine[1] != "SPIN" && parsedLine[1] != "HYBRID"))
+				cerr << "Error: Wrong haptic wait mode in the configuration file!";
+			else
+			{
+				m_hapticWait = parsedLine[1];
+				if (parsedLine.size() == 3)
+					m_hapticSpinTime = stod(parsedLine[2]) / 1e6;
+			}
+		}
+		else if (parsedLine[0] == "CPU")
+		{
+			if (parsedLine.size() != 2 || stoi(parsedLine[1]) < -1)
+				cerr << "Error: Wrong haptic CPU in the configuration file!";
+			else
+				m_hapticCpu = stoi(parsedLine[1]);
+		}
+		else if (parsedLine[0] == "REALTIME")
+		{
+			if (parsedLine.size() != 2 || stoi(parsedLine[1]) < 0 || stoi(parsedLine[1]) > 99)
+				cerr << "Error: Wrong real-time priority in the configuration file!";
+			else
+				m_hapticPriority = stoi(parsedLine[1]);
+		}
+		else if (parsedLine[0] == "DEVICE")
+		{
+			if (parsedLine.size() < 2 || parsedLine.size() > 4 || (parsedLine[1] != "PHYSICAL" && parsedLine[1] != "SIMULATED") ||
+				(parsedLine.size() >= 3 && stod(parsedLine[2]) <= 0.0) || (parsedLine.size() == 4 && parsedLine[3] != "FAST"))
+				cerr << "Error: Wrong haptic device in the configuration file!";
+			else
+			{
+				m_device = parsedLine[1];
+				if (parsedLine.size() >= 3)
+					m_simRate = stod(parsedLine[2]);
+				m_simRealTime = (parsedLine.size() != 4);
+			}
+		}
+		else if (parsedLine[0] == "DEVICES")
+		{
+			if (parsedLine.size() != 2 || stoi(parsedLine[1]) < 1)
+				cerr << "Error: Wrong number of haptic devices in the configuration file!";
+			else
+				m_numDevices = stoi(parsedLine[1]);
+		}
+		else if (parsedLine[0] == "TRACE")
+		{
+			if (parsedLine.size() < 3 || parsedLine.size() > 4 || (parsedLine[1] != "RECORD" && parsedLine[1] != "REPLAY") ||
+				(parsedLine.size() == 4 && (parsedLine[1] != "REPLAY" || parsedLine[3] != "FAST")))
+				cerr << "Error: Wrong input trace in the configuration file!";
+			else
+			{
+				m_traceMode = parsedLine[1];
+				m_traceFile = parsedLine[2];
+				m_traceRealTime = (parsedLine.size() != 4);
+			}
+		}
+		else if (parsedLine[0] == "FRAMERATE")
+		{
+			if (parsedLine.size() < 2 || parsedLine.size() > 3 || (parsedLine[1] != "VSYNC" && stod(parsedLine[1]) <= 0.0) ||
+				(parsedLine.size() == 3 && (parsedLine[1] != "VSYNC" || stod(parsedLine[2]) < 0.0)))
+				cerr << "Error: Wrong frame rate in the configuration file!";
+			else
+			{
+				m_frameVsync = (parsedLine[1] == "VSYNC");
+				m_frameRate = m_frameVsync ? (parsedLine.size() == 3 ? stod(parsedLine[2]) : 0.0) : stod(parsedLine[1]);
+			}
+		}
+		else if (parsedLine[0] == "PREDICTION")
+		{
+			if (parsedLine.size() != 2 || (parsedLine[1] != "AUTO" && parsedLine[1] != "OFF" && stod(parsedLine[1]) < 0.0))
+				cerr << "Error: Wrong pose prediction in the configuration file!";
+			else if (parsedLine[1] == "AUTO" || parsedLine[1] == "OFF")
+				m_prediction = parsedLine[1];
+			else
+			{
+				m_prediction = "FIXED";
+				m_predictionHorizon = stod(parsedLine[1]) / 1e3;
+			}
+		}
+		else if (parsedLine[0] == "COLLISION")
+		{
+			if (parsedLine.size() != 2 || (parsedLine[1] != "ANALYTIC" && parsedLine[1] != "MESH"))
+				cerr << "Error: Wrong collision mode in the configuration file!";
+			else
+				m_collision = parsedLine[1];
+		}
+		else if (parsedLine[0] == "MATCH")
+		{
+			if (parsedLine.size() < 2 || parsedLine.size() > 4 || (parsedLine[1] != "PIPS" && parsedLine[1] != "SHAPE") ||
+				(parsedLine.size() >= 3 && stod(parsedLine[2]) < 0.0) || (parsedLine.size() == 4 && stod(parsedLine[3]) < 0.0))
+				cerr << "Error: Wrong orientation match in the configuration file!";
+			else
+			{
+				m_matchShape = (parsedLine[1] == "SHAPE");
+				if (parsedLine.size() >= 3)
+					m_matchThreshold = stod(parsedLine[2]) * DEG2RAD;
+				if (parsedLine.size() == 4)
+					m_matchHoldTime = stod(parsedLine[3]);
+			}
+		}
 		else if (parsedLine[0] == "ID")
 		{
 			if (parsedLine.size() > 2)
@@ -133,4 +297,13 @@ void ConfFile::openConfFile(string s)
 {
 	m_fileName = s;
 	loadConfFile();
+}
+
+unsigned long long ConfFile::getHash()
+{
+	// the resolved rotations are hashed, so RANDOM rotations are covered too
+	unsigned long long hash = hdataHash(m_participantID.data(), m_participantID.size());
+	for (size_t i = 0; i < m_rotations.size(); i++)
+		hash = hdataHash(&m_rotations[i][0], m_rotations[i].size() * sizeof(double), hash);
+	return hash;
 }
\ No newline at end of file
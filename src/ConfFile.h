@@ -16,6 +16,35 @@ public:
 	string m_participantID;		// name/id of the participant
 	vector<vector<double> > m_rotations;	// list of rotations in the configuration file (format: <vector_x, vector_y, vector_z, angle>, note that the angle is in radians)
 	int m_numSubExp;				// number of subexperiments (ie number of ROT in the conf file)
+	double m_flushLatency = 0.1;	// maximum time [s] a complete data block waits before it is written (format: FLUSH <ms>)
+	bool m_logFloat32 = false;		// store logged values as float32 instead of float64 (format: FORMAT FLOAT|DOUBLE|DELTA)
+	bool m_logDelta = false;		// store logged values delta coded (format: FORMAT DELTA)
+	double m_logPrecision = 1e-5;	// quantization step of delta coded values (format: PRECISION <step>)
+	string m_logWriter = "STDIO";	// backend writing the data file (format: WRITER STDIO|MMAP|ASYNC|DIRECT)
+	bool m_logAdaptive = false;		// log idle ticks decimated/change-driven instead of every tick (format: LOGPOLICY FULL|ADAPTIVE)
+	double m_logIdleRate = 50.0;	// rate [Hz] of the periodic idle samples in adaptive logging (format: IDLERATE <Hz>)
+	double m_logPosThreshold = 1e-4;	// idle position change [m] that is logged immediately (format: THRESHOLD <m> <deg>)
+	double m_logAngleThreshold = 0.1 * 0.017453292519943;	// idle rotation [rad] that is logged immediately
+	double m_hapticRate = 0.0;		// target rate [Hz] of the haptic loop, 0 runs it as fast as possible (format: HAPTICRATE <Hz>)
+	string m_hapticWait = "HYBRID";	// how the haptic loop waits for its next tick (format: WAIT SLEEP|SPIN|HYBRID [<spin us>])
+	double m_hapticSpinTime = 200e-6;	// busy waiting time [s] at the end of a HYBRID wait
+	int m_hapticCpu = -1;			// core the first haptic thread is pinned to, the others to the following cores, -1 for none (format: CPU <core>)
+	int m_hapticPriority = 0;		// SCHED_FIFO priority of the haptic thread, 0 to keep the default (format: REALTIME <priority>)
+	string m_device = "PHYSICAL";	// haptic device, SIMULATED plays a scripted session (format: DEVICE PHYSICAL|SIMULATED [<Hz> [FAST]])
+	int m_numDevices = 1;			// number of haptic devices, each with its own haptic thread and data file (format: DEVICES <n>)
+	double m_simRate = 1000.0;		// servo rate [Hz] of the simulated device
+	bool m_simRealTime = true;		// pace the simulated device to the wall clock (FAST runs it as fast as possible)
+	string m_traceMode = "OFF";		// record the device inputs to a trace or replay them from one (format: TRACE RECORD|REPLAY <file> [FAST])
+	string m_traceFile;				// input trace file
+	bool m_traceRealTime = true;	// replay at the recorded pace (FAST replays as fast as possible)
+	bool m_frameVsync = true;		// swap the buffers on the vertical retrace (format: FRAMERATE VSYNC [<max Hz>] | FRAMERATE <Hz>)
+	double m_frameRate = 0.0;		// target frame rate [Hz] of the graphics loop, the largest one with VSYNC, 0 for none
+	string m_prediction = "AUTO";	// extrapolate the drawn poses to the display time: measured horizon, fixed horizon or not at all (format: PREDICTION AUTO|OFF|<ms>)
+	double m_predictionHorizon = 0.0;	// fixed time [s] from the start of a frame to its display
+	string m_collision = "ANALYTIC";	// tool contact with the dice and the button: analytic box/sphere or AABB trees of the meshes (format: COLLISION ANALYTIC|MESH)
+	bool m_matchShape = false;		// match the dice modulo the 24 rotations of the cube, ignoring the pips (format: MATCH PIPS|SHAPE [<deg> [<hold s>]])
+	double m_matchThreshold = 0.0;	// angle [rad] below which a trial completes without the button, 0 for never
+	double m_matchHoldTime = 0.5;	// time [s] the dice must stay matched and released before the trial completes
 
 public:
 	ConfFile();
@@ -25,6 +54,7 @@ public:
 public:
 	void openConfFile(); // open a configuration file
 	void openConfFile(string s); // open a configuration file
+	unsigned long long getHash(); // hash of the loaded configuration (participant id and rotations)
 
 private:
 	void loadConfFile(void);
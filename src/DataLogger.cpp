@@ -0,0 +1,339 @@
+#include "DataLogger.h"
+
+using namespace chai3d;
+
+
+DataLogger::DataLogger()
+	: m_pool(POOL_SIZE, true), m_buffer(&m_pool)
+{
+	m_maxFlushLatency = 0.1;
+	m_float32 = false;
+	m_delta = false;
+	m_precision = 1e-5;
+	m_writerBackend = "STDIO";
+
+	m_wakeups = 0;
+	m_bytesWritten = 0;
+	m_writeTimeUs = 0;
+	m_encodeTimeUs = 0;
+	m_rawBytes = 0;
+	m_lastBlockRatio = 0.0;
+	m_lastBlockThroughput = 0.0;
+
+	m_writer = 0;
+	m_samplesWritten = 0;
+	m_samplesSinceSignal = 0;
+	m_stopRequested = false;
+	m_finished = false;
+}
+
+DataLogger::~DataLogger()
+{
+	close();
+}
+
+bool DataLogger::open(string fileName, string participantID, unsigned long long configHash)
+{
+	m_writer = LogWriter::create(m_writerBackend);
+	if (m_writer == 0)
+	{
+		cerr << "Error: Unknown data writer " << m_writerBackend << "!" << endl;
+		return false;
+	}
+
+	if (!m_writer->open(fileName))
+	{
+		cerr << "Error: Output data file could not be opened!" << endl;
+		delete m_writer;
+		m_writer = 0;
+		return false;
+	}
+
+	m_header.m_participantID = participantID;
+	m_header.m_configHash = configHash;
+	m_index.clear();
+	if (m_delta)
+		m_header.setDeltaSchema(m_precision);
+	else
+		m_header.setSchema(m_float32);
+	m_header.m_flags |= HDATA_FLAG_INDEX;
+	m_codec.setup(m_header);
+
+	vector<unsigned char> header;
+	m_header.write(header);
+	if (!m_writer->write(&header[0], header.size()))
+	{
+		cerr << "Error: Output data file header could not be written!" << endl;
+		return false;
+	}
+	m_bytesWritten += header.size();
+
+	m_records.resize(BLOCK_SIZE);
+	m_samplesWritten = 0;
+	m_startTime = m_stopTime = chrono::steady_clock::now();
+
+	return true;
+}
+
+void DataLogger::close()
+{
+	if (m_writer != 0)
+	{
+		// the trial index goes after the last record
+		vector<unsigned char> index;
+		hdataWriteIndex(m_index, m_writer->getSize(), index);
+		if (!m_writer->write(&index[0], index.size()))
+			cerr << "Error: Trial index could not be written!" << endl;
+
+		// fill in the sample count and mean sample rate now that they are known
+		double duration = chrono::duration<double>(m_stopTime - m_startTime).count();
+		unsigned char patch[16];
+		hdataPutF64(patch, duration > 0.0 ? m_samplesWritten / duration : 0.0);
+		hdataPutU64(patch + 8, m_samplesWritten);
+
+		if (!m_writer->writeAt(HDATA_OFFSET_SAMPLE_RATE, patch, 16))
+			cerr << "Error: Output data file header could not be completed!" << endl;
+
+		m_writer->close();
+
+		m_writerStatistics = m_writer->getStatistics();
+		delete m_writer;
+		m_writer = 0;
+	}
+}
+
+bool DataLogger::log(const HapticData& sample)
+{
+	if (!m_ring.try_push(sample))
+		return false;
+
+	// wake the flushing thread once per block; the notification is not
+	// synchronized with its wait, so a lost wake-up costs at most one
+	// m_maxFlushLatency period
+	if (++m_samplesSinceSignal >= BLOCK_SIZE)
+	{
+		m_samplesSinceSignal = 0;
+		m_blockReady.notify_one();
+	}
+	return true;
+}
+
+void DataLogger::run()
+{
+	chrono::microseconds timeout((long long)(m_maxFlushLatency * 1e6));
+
+	while (!m_stopRequested)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_blockReady.wait_for(lock, timeout, [this] { return m_stopRequested || m_ring.size() >= BLOCK_SIZE; });
+		}
+		++m_wakeups;
+
+		drainRing();
+		writeBlocks(false);
+	}
+
+	// no more samples will come; write everything including the partial tail block
+	drainRing();
+	writeBlocks(true);
+
+	m_finished = true;
+}
+
+void DataLogger::stop()
+{
+	m_stopTime = chrono::steady_clock::now();
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopRequested = true;
+	}
+	m_blockReady.notify_one();
+}
+
+bool DataLogger::isFinished()
+{
+	return m_finished;
+}
+
+size_t DataLogger::getDroppedSamples()
+{
+	return m_ring.dropped();
+}
+
+void DataLogger::printStatistics()
+{
+	if (getDroppedSamples() > 0)
+		cerr << "Warning: " << getDroppedSamples() << " sample(s) were dropped by the data logger!" << endl;
+
+	cout << "Data logger: " << m_samplesWritten << " samples, "
+		<< m_bytesWritten << " bytes written in " << m_writeTimeUs / 1000.0 << " ms, "
+		<< m_wakeups << " wake-up(s)" << endl;
+
+	if (m_bytesWritten > 0 && m_encodeTimeUs > 0)
+		cout << "Data encoding: compression ratio " << (double)m_rawBytes / m_bytesWritten
+			<< " (last block " << m_lastBlockRatio << "), "
+			<< m_rawBytes / (double)m_encodeTimeUs << " MB/s (last block " << m_lastBlockThroughput << " MB/s)" << endl;
+
+	if (m_writerStatistics != "")
+		cout << "Data writer: " << m_writerStatistics << endl;
+
+	cout << "Data blocks: " << m_pool.nodes_in_use() << " in use, high-water mark " << m_pool.high_water_mark()
+		<< " of " << m_pool.capacity() << (m_pool.huge_pages() ? " (huge pages)" : "");
+	if (m_pool.overflow_allocations() > 0)
+		cout << ", " << m_pool.overflow_allocations() << " heap allocation(s)";
+	cout << endl;
+}
+
+void DataLogger::drainRing()
+{
+	HapticData* samples;
+	size_t count;
+
+	// move everything the haptic thread has published into the block buffer
+	while ((count = m_ring.peek(samples)) > 0)
+	{
+		for (size_t i = 0; i < count; i++)
+			m_buffer.push_back(samples[i]);
+
+		m_ring.pop(count);
+	}
+}
+
+void DataLogger::writeBlocks(bool all)
+{
+	if (m_writer == 0)
+		return;
+
+	// nothing sealed yet: don't touch the file at all
+	if (!all && m_buffer.sealed_index() == m_buffer.begin_index())
+		return;
+
+	auto sink = [this](const HapticData* samples, size_t count) { return writeBlock(samples, count); };
+
+	int error = all ? m_buffer.flush_to(sink) : m_buffer.safe_flush_to(sink);
+	if (error)
+		cerr << "Error: Data could not be written (" << error << ")!" << endl;
+
+	// start writing back what was committed without waiting for it
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	m_writer->sync();
+	m_writeTimeUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+int DataLogger::writeBlock(const HapticData* samples, size_t count)
+{
+	// split the block where the trial changes, so that every trial starts a
+	// new chunk that can be found through the index (and decoded on its own)
+	size_t begin = 0;
+	while (begin < count)
+	{
+		size_t end = begin + 1;
+		while (end < count && samples[end].trial == samples[begin].trial)
+			end++;
+
+		int error = writeChunk(samples + begin, end - begin);
+		if (error)
+			return error;
+
+		begin = end;
+	}
+	return 0;
+}
+
+int DataLogger::writeChunk(const HapticData* samples, size_t count)
+{
+	// pack or code the chunk, then write it with a single call
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	if (m_index.empty() || m_index.back().trial != (unsigned int)samples[0].trial)
+	{
+		HdataTrialIndex entry;
+		entry.trial = samples[0].trial;
+		entry.offset = m_writer->getSize();
+		entry.sampleCount = 0;
+		entry.startTime = entry.endTime = samples[0].time;
+
+		// trial k is played with the reference dice rotated by rotation k-1 (see updateHaptics)
+		for (int k = 0; k < 4; k++)
+			entry.rotation[k] = 0.0;
+		if (entry.trial >= 1 && entry.trial <= m_trialRotations.size() && m_trialRotations[entry.trial - 1].size() == 4)
+		{
+			for (int k = 0; k < 4; k++)
+				entry.rotation[k] = m_trialRotations[entry.trial - 1][k];
+		}
+
+		m_index.push_back(entry);
+	}
+
+	for (size_t i = 0; i < count; i++)
+		toRecord(samples[i], m_records[i]);
+
+	// encode straight into the writer's buffer (or file mapping)
+	size_t maxBytes = m_delta ? m_codec.getMaxEncodedSize(count) : count * m_header.m_recordSize;
+	unsigned char* out = m_writer->reserve(maxBytes);
+	if (out == 0)
+		return -1;
+
+	size_t bytes = 0;
+	if (m_delta)
+	{
+		bytes = m_codec.encodeBlock(&m_records[0], count, out);
+	}
+	else
+	{
+		for (size_t i = 0; i < count; i++)
+			bytes += m_header.encode(m_records[i], out + bytes);
+	}
+
+	chrono::steady_clock::time_point encoded = chrono::steady_clock::now();
+	bool committed = m_writer->commit(bytes);
+	chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+	long long encodeUs = chrono::duration_cast<chrono::microseconds>(encoded - start).count();
+	size_t rawBytes = count * m_header.getNumValues() * 8;
+
+	m_encodeTimeUs += encodeUs;
+	m_rawBytes += rawBytes;
+	m_lastBlockRatio = (double)rawBytes / bytes;
+	if (encodeUs > 0)
+		m_lastBlockThroughput = (double)rawBytes / encodeUs;
+
+	m_writeTimeUs += chrono::duration_cast<chrono::microseconds>(end - encoded).count();
+	if (!committed)
+		return -1;
+	m_bytesWritten += bytes;
+
+	m_index.back().sampleCount += count;
+	m_index.back().endTime = samples[count - 1].time;
+
+	m_samplesWritten += count;
+	return 0;
+}
+
+void DataLogger::toRecord(const HapticData& sample, HdataRecord& record)
+{
+	cQuaternion q;
+
+	record.time = sample.time;
+	record.trial = sample.trial;
+	record.flags = sample.flags;
+	record.tick = (double)sample.tick;
+	record.matchAngle = sample.matchAngle;
+
+	q.fromRotMat(sample.refDiceOrientation);
+	record.refDiceQuat[0] = q.w; record.refDiceQuat[1] = q.x; record.refDiceQuat[2] = q.y; record.refDiceQuat[3] = q.z;
+
+	q.fromRotMat(sample.actDiceOrientation);
+	record.actDiceQuat[0] = q.w; record.actDiceQuat[1] = q.x; record.actDiceQuat[2] = q.y; record.actDiceQuat[3] = q.z;
+
+	q.fromRotMat(sample.deviceOrientation);
+	record.deviceQuat[0] = q.w; record.deviceQuat[1] = q.x; record.deviceQuat[2] = q.y; record.deviceQuat[3] = q.z;
+
+	for (int i = 0; i < 3; i++)
+	{
+		record.actDicePos[i] = sample.actDicePos(i);
+		record.devicePos[i] = sample.devicePos(i);
+		record.deviceVel[i] = sample.deviceVel(i);
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "HapticData.h"
+#include "HdataFormat.h"
+#include "HdataCodec.h"
+#include "LogWriter.h"
+#include "block_linked_list.h"
+#include "spsc_ring.h"
+
+using namespace std;
+
+// Logs HapticData samples from the haptic thread to an .hdata file (see
+// HdataFormat.h for the file layout).
+//
+// The haptic thread calls log(), which only copies the sample into a
+// lock-free ring.  The flushing thread runs run(): it sleeps until a
+// block's worth of samples is available (or m_maxFlushLatency expires),
+// groups them into blocks and writes the complete blocks.  The partial
+// tail block is only written once stop() has been called.  The samples are
+// converted to the packed, portable record layout (or delta coded) on the
+// flushing thread.
+class DataLogger
+{
+public:
+	enum { BLOCK_SIZE = 1000, RING_SIZE = 4096, POOL_SIZE = 8 };
+
+	double m_maxFlushLatency;		// longest time [s] a sealed block may wait before it is written
+	bool m_float32;					// store values as f32 (packed records only)
+	bool m_delta;					// store delta coded blocks instead of packed records
+	double m_precision;				// quantization step of delta coded values
+	string m_writerBackend;			// "STDIO", "MMAP", "ASYNC" or "DIRECT" (see LogWriter.h)
+	vector<vector<double> > m_trialRotations;	// rotations of the experiment, for the trial index
+
+	atomic<unsigned long long> m_wakeups;		// number of times the flushing thread woke up
+	atomic<unsigned long long> m_bytesWritten;	// number of bytes written to the file
+	atomic<unsigned long long> m_writeTimeUs;	// time spent committing/syncing blocks in the writer [us]
+	atomic<unsigned long long> m_encodeTimeUs;	// time spent packing/coding blocks [us]
+	atomic<unsigned long long> m_rawBytes;		// size the written samples have as f64 packed records
+	atomic<double> m_lastBlockRatio;			// compression ratio of the last block (raw / stored)
+	atomic<double> m_lastBlockThroughput;		// encoding throughput of the last block [MB/s of raw data]
+
+public:
+	DataLogger();
+	~DataLogger();
+
+public:
+	bool open(string fileName, string participantID, unsigned long long configHash);	// open the output file and write the header
+	void close();				// complete the header and close the output file (after run() has returned)
+
+	bool log(const HapticData& sample);	// haptic thread: queue a sample, never blocks
+
+	void run();				// flushing thread: write blocks until stop() is called
+	void stop();			// ask run() to write everything and return
+	bool isFinished();		// true once run() has written its last block
+
+	size_t getDroppedSamples();
+	void printStatistics();
+
+private:
+	void drainRing();
+	void writeBlocks(bool all);
+	int writeBlock(const HapticData* samples, size_t count);
+	int writeChunk(const HapticData* samples, size_t count);
+	void toRecord(const HapticData& sample, HdataRecord& record);
+
+private:
+	LogWriter* m_writer;
+	string m_writerStatistics;
+	HdataHeader m_header;
+	HdataCodec m_codec;
+	vector<HdataTrialIndex> m_index;	// one entry per trial written so far
+	vector<HdataRecord> m_records;		// one block of converted samples
+	unsigned long long m_samplesWritten;
+	chrono::steady_clock::time_point m_startTime;
+	chrono::steady_clock::time_point m_stopTime;
+
+	spsc_ring<HapticData, RING_SIZE> m_ring;
+	block_linked_list_pool<HapticData, BLOCK_SIZE> m_pool;
+	block_linked_list<HapticData, BLOCK_SIZE> m_buffer;
+
+	// sleeping/waking the flushing thread; the haptic thread only ever notifies
+	mutex m_mutex;
+	condition_variable m_blockReady;
+	unsigned int m_samplesSinceSignal;
+
+	atomic<bool> m_stopRequested;
+	atomic<bool> m_finished;
+};
@@ -0,0 +1,254 @@
+#include "FramePacer.h"
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#elif defined(MACOSX)
+#include <OpenGL/OpenGL.h>
+#else
+#include <GL/glx.h>
+#endif
+
+// the timer queries and fences come through GLEW, which chai3d includes
+#if defined(GLEW_VERSION)
+#define FRAME_PACER_GPU_QUERIES
+#endif
+
+
+FramePacer::FramePacer()
+{
+	m_vsync = true;
+	m_rate = 0.0;
+
+	m_vsyncActive = false;
+	m_timerPeriodSet = false;
+	m_timerQueries = false;
+	m_fences = false;
+	m_next = 0;
+	m_lastStart = 0;
+	m_frames = 0;
+	m_lostQueries = 0;
+	m_current = 0;
+
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		m_slots[i].pending = false;
+		m_slots[i].frameStart = 0;
+		m_slots[i].gpuOffset = 0;
+		m_slots[i].queries[0] = m_slots[i].queries[1] = 0;
+		m_slots[i].fence = 0;
+	}
+}
+
+FramePacer::~FramePacer()
+{
+#if defined(_WIN32)
+	if (m_timerPeriodSet)
+		timeEndPeriod(1);
+#endif
+}
+
+bool FramePacer::setSwapInterval(int interval)
+{
+#if defined(_WIN32)
+	typedef BOOL (WINAPI *SwapIntervalProc)(int);
+	SwapIntervalProc swapInterval = (SwapIntervalProc)wglGetProcAddress("wglSwapIntervalEXT");
+	return swapInterval != 0 && swapInterval(interval) != FALSE;
+#elif defined(MACOSX)
+	GLint value = interval;
+	return CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &value) == kCGLNoError;
+#else
+	typedef int (*SwapIntervalProc)(int);
+	SwapIntervalProc swapInterval = (SwapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
+	if (swapInterval == 0)
+		swapInterval = (SwapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
+	return swapInterval != 0 && swapInterval(interval) == 0;
+#endif
+}
+
+void FramePacer::start()
+{
+	// drivers may swap on the retrace by default, so set it either way
+	m_vsyncActive = setSwapInterval(m_vsync ? 1 : 0) && m_vsync;
+	if (m_vsync && !m_vsyncActive)
+	{
+		if (m_rate <= 0.0)
+			m_rate = 60.0;
+		cerr << "Warning: Vertical sync could not be enabled, frames are paced at " << m_rate << " Hz!" << endl;
+	}
+
+#if defined(_WIN32)
+	// the GLUT timer sleeps with the resolution of the system timer, 15.6 ms by default
+	if (m_rate > 0.0)
+		m_timerPeriodSet = (timeBeginPeriod(1) == TIMERR_NOERROR);
+#endif
+
+#ifdef FRAME_PACER_GPU_QUERIES
+	m_timerQueries = (GLEW_ARB_timer_query != 0);
+	m_fences = (GLEW_ARB_sync != 0);
+	if (m_timerQueries)
+	{
+		for (int i = 0; i < NUM_SLOTS; i++)
+			glGenQueries(2, m_slots[i].queries);
+	}
+#endif
+	if (!m_timerQueries)
+		cerr << "Warning: No GL timer queries, the GPU time of the frames is not measured!" << endl;
+
+	m_next = latencyNow();
+}
+
+int FramePacer::getDelayMs()
+{
+	// without a rate the swap waits for the retrace
+	if (m_rate <= 0.0)
+		return 0;
+
+	// rounded up: a frame is only due once its deadline has passed
+	unsigned long long now = latencyNow();
+	return (now >= m_next) ? 0 : (int)((m_next - now + 999999) / 1000000);
+}
+
+void FramePacer::beginFrame()
+{
+	unsigned long long start = latencyNow();
+	if (m_lastStart != 0)
+		m_interval.record(start - m_lastStart);
+	m_lastStart = start;
+
+	// next frame on the schedule; an early frame takes its slot, frames
+	// that are already late are skipped
+	if (m_rate > 0.0)
+	{
+		unsigned long long period = (unsigned long long)(1e9 / m_rate);
+		if (m_next <= start)
+			m_next += ((start - m_next) / period + 1) * period;
+		else
+			m_next += period;
+	}
+
+	collect();
+
+	Slot& slot = m_slots[m_current];
+
+#ifdef FRAME_PACER_GPU_QUERIES
+	// let the driver queue at most one frame ahead: wait for the one before the previous
+	Slot& throttle = m_slots[(m_current + NUM_SLOTS - 2) % NUM_SLOTS];
+	if (m_fences && throttle.fence != 0)
+	{
+		glClientWaitSync((GLsync)throttle.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+		glDeleteSync((GLsync)throttle.fence);
+		throttle.fence = 0;
+	}
+
+	if (m_timerQueries)
+	{
+		// results that did not arrive in NUM_SLOTS frames are lost
+		if (slot.pending)
+			m_lostQueries++;
+
+		glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+
+		// relate the GPU clock to ours, it drifts
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		slot.gpuOffset = (long long)latencyNow() - (long long)gpuNow;
+		slot.pending = true;
+	}
+#endif
+
+	slot.frameStart = start;
+}
+
+void FramePacer::beforeSwap()
+{
+	m_cpuTime.record(latencyNow() - m_slots[m_current].frameStart);
+}
+
+void FramePacer::endFrame()
+{
+#ifdef FRAME_PACER_GPU_QUERIES
+	Slot& slot = m_slots[m_current];
+	if (m_timerQueries)
+		glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+	if (m_fences)
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+	m_current = (m_current + 1) % NUM_SLOTS;
+	m_frames++;
+}
+
+void FramePacer::collect()
+{
+#ifdef FRAME_PACER_GPU_QUERIES
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		Slot& slot = m_slots[i];
+		if (!slot.pending)
+			continue;
+
+		// never wait for a result, it is picked up in a later frame
+		GLint available = 0;
+		glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+		slot.pending = false;
+
+		if (end >= begin)
+			m_gpuTime.record(end - begin);
+		long long present = (long long)end + slot.gpuOffset - (long long)slot.frameStart;
+		if (present > 0)
+			m_presentLatency.record((unsigned long long)present);
+	}
+#endif
+}
+
+unsigned long long FramePacer::getPresentEstimate() const
+{
+	if (m_presentLatency.getCount() > 0)
+		return m_presentLatency.getPercentile(50.0);
+	return (unsigned long long)m_interval.getMean();
+}
+
+string FramePacer::getSummary() const
+{
+	double mean = m_interval.getMean();
+	char text[256];
+	sprintf(text, "%.0f fps%s, cpu p99 %.2f ms, gpu p99 %.2f ms, present p99 %.2f ms",
+		mean > 0.0 ? 1e9 / mean : 0.0, m_vsyncActive ? " (vsync)" : "",
+		m_cpuTime.getPercentile(99.0) / 1e6, m_gpuTime.getPercentile(99.0) / 1e6,
+		m_presentLatency.getPercentile(99.0) / 1e6);
+	return text;
+}
+
+void FramePacer::printStatistics(ostream& out) const
+{
+	if (m_frames == 0)
+		return;
+
+	char line[256];
+
+	out << "Graphics: " << m_frames << " frames, " << getSummary() << endl;
+	sprintf(line, "  %-26s %12s %10s %10s %10s %10s %10s", "frame [us]", "count", "mean", "p50", "p99", "p99.9", "max");
+	out << line << endl;
+
+	const char* names[] = { "cpu", "gpu", "present latency", "interval" };
+	const LatencyHistogram* histograms[] = { &m_cpuTime, &m_gpuTime, &m_presentLatency, &m_interval };
+	for (int i = 0; i < 4; i++)
+	{
+		const LatencyHistogram& h = *histograms[i];
+		sprintf(line, "  %-26s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f", names[i], h.getCount(),
+			h.getMean() / 1e3, h.getPercentile(50.0) / 1e3, h.getPercentile(99.0) / 1e3,
+			h.getPercentile(99.9) / 1e3, h.getMax() / 1e3);
+		out << line << endl;
+	}
+	if (m_lostQueries > 0)
+		out << "  " << m_lostQueries << " GPU timer results arrived too late and were lost" << endl;
+}
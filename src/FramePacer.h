@@ -0,0 +1,94 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include "chai3d.h"
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+// Paces and times the frames of the graphics loop.
+//
+// With m_vsync on, buffers are swapped on the vertical retrace and the
+// display paces the loop (60-144 Hz); m_rate > 0 caps the rate below
+// that.  With m_vsync off (or when the driver does not let us enable it)
+// frames are due at m_rate on a fixed schedule, frame k at start + k /
+// m_rate, so a late frame does not push back the ones after it.
+// getDelayMs() tells the GLUT timer how long to sleep until the next
+// frame is due.
+//
+// Nothing waits for the GPU to drain (no glFinish): beginFrame() only
+// waits until the frame before the previous one has been executed, so
+// the driver queues at most one frame ahead of the one being drawn.
+//
+// Every frame records
+//	- the CPU time from beginFrame() to beforeSwap(),
+//	- the GPU time between the timestamps of beginFrame() and endFrame()
+//	  (timer queries, read back some frames later without stalling),
+//	- the present latency: from beginFrame(), where the snapshots of the
+//	  haptic threads are read, until the GPU has executed the swap,
+//	- the interval between the starts of consecutive frames.
+// The GPU measures need ARB_timer_query (and the throttle ARB_sync);
+// without them only the CPU measures are recorded.
+//
+// All methods belong to the graphics thread except the statistics,
+// which may be read from any thread (see LatencyHistogram).
+class FramePacer
+{
+public:
+	bool m_vsync;		// swap on the vertical retrace
+	double m_rate;		// target (vsync: largest) frame rate [Hz], 0 for none
+
+public:
+	FramePacer();
+	~FramePacer();
+
+public:
+	void start();		// once the GL context exists: swap interval, queries
+	int getDelayMs();	// time [ms] until the next frame is due
+
+	void beginFrame();
+	void beforeSwap();
+	void endFrame();
+
+	bool isVsync() const { return m_vsyncActive; }
+	unsigned long long getFrameStart() const { return m_lastStart; }	// latencyNow() at the last beginFrame()
+	unsigned long long getPresentEstimate() const;	// typical present latency [ns], one frame if not measured
+	const LatencyHistogram& getCpuTime() const { return m_cpuTime; }
+	const LatencyHistogram& getGpuTime() const { return m_gpuTime; }
+	const LatencyHistogram& getPresentLatency() const { return m_presentLatency; }
+	const LatencyHistogram& getInterval() const { return m_interval; }
+
+	string getSummary() const;			// one line about the frames, for a label
+	void printStatistics(ostream& out) const;
+
+private:
+	enum { NUM_SLOTS = 4 };			// frames whose queries may be in flight
+
+	struct Slot
+	{
+		bool pending;
+		unsigned long long frameStart;	// latencyNow() at beginFrame() [ns]
+		long long gpuOffset;			// latencyNow() - GL timestamp at beginFrame() [ns]
+		unsigned int queries[2];		// GL timestamps at beginFrame() and endFrame()
+		void* fence;					// GLsync after the swap
+	};
+
+	bool setSwapInterval(int interval);
+	void collect();		// record the timer queries that have finished
+
+	bool m_vsyncActive;
+	bool m_timerPeriodSet;
+	bool m_timerQueries;
+	bool m_fences;
+	unsigned long long m_next;			// time the next frame is due [ns]
+	unsigned long long m_lastStart;
+	unsigned long long m_frames;
+	unsigned long long m_lostQueries;	// slots reused before their queries were available
+	Slot m_slots[NUM_SLOTS];
+	int m_current;
+
+	LatencyHistogram m_cpuTime;
+	LatencyHistogram m_gpuTime;
+	LatencyHistogram m_presentLatency;
+	LatencyHistogram m_interval;
+};
@@ -0,0 +1,46 @@
+#include "GrabArbiter.h"
+
+
+GrabArbiter::GrabArbiter()
+{
+	m_holder = NOBODY;
+	m_grabs = 0;
+	m_internalGrabs = 0;
+	m_conflicts = 0;
+	m_refused = 0;
+}
+
+bool GrabArbiter::tryGrab(int station, bool internal)
+{
+	// a plain load first; stations retry every tick while another one
+	// holds the object, and only a free object is worth a compare-and-swap
+	int expected = m_holder.load(memory_order_acquire);
+	if (expected == station)
+		return true;
+
+	if (expected == NOBODY && m_holder.compare_exchange_strong(expected, station, memory_order_acq_rel))
+	{
+		(internal ? m_internalGrabs : m_grabs).fetch_add(1, memory_order_relaxed);
+		return true;
+	}
+
+	// housekeeping waits for the holder; only refused participants conflict
+	if (internal)
+		return false;
+
+	// a station retries on every tick; count it once per hold
+	unsigned int bit = 1u << (station & 31);
+	if ((m_refused.load(memory_order_relaxed) & bit) == 0)
+	{
+		m_refused.fetch_or(bit, memory_order_relaxed);
+		m_conflicts.fetch_add(1, memory_order_relaxed);
+	}
+	return false;
+}
+
+void GrabArbiter::release(int station)
+{
+	int expected = station;
+	if (m_holder.compare_exchange_strong(expected, NOBODY, memory_order_acq_rel))
+		m_refused.store(0, memory_order_relaxed);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+
+using namespace std;
+
+// Decides which haptic station holds a shared object (the actual dice).
+//
+// Every station runs its own haptic thread, and only the holder of the
+// object decides where it goes.  A station grabs the object with one
+// compare-and-swap from NOBODY to its index and lets it go with another;
+// a failed grab (someone else holds the object) returns at once, so the
+// real-time loops never wait for each other.  The holder does not write
+// the object itself: it publishes the pose, and the first station applies
+// it (see HapticStation.h).
+//
+// The counters count transitions: a grab when the object passes from
+// NOBODY to a station, a conflict the first time a station is refused
+// during a hold, however often it retries until the object is released.
+// Grabs the application makes for its own housekeeping (internal) are
+// counted apart, so the statistics report what the participants did.
+class GrabArbiter
+{
+public:
+	enum { NOBODY = -1 };
+
+public:
+	GrabArbiter();
+
+public:
+	bool tryGrab(int station, bool internal = false);	// true if the station holds the object now
+	void release(int station);		// no-op if the station does not hold it
+	bool holds(int station) const { return m_holder.load(memory_order_acquire) == station; }
+	int getHolder() const { return m_holder.load(memory_order_acquire); }
+
+	unsigned long long getGrabs() const { return m_grabs; }
+	unsigned long long getInternalGrabs() const { return m_internalGrabs; }
+	unsigned long long getConflicts() const { return m_conflicts; }	// grabs refused because another station held the object
+
+private:
+	atomic<int> m_holder;
+	atomic<unsigned long long> m_grabs;
+	atomic<unsigned long long> m_internalGrabs;
+	atomic<unsigned long long> m_conflicts;
+	atomic<unsigned int> m_refused;		// bit per station refused during the current hold
+};
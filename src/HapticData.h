@@ -0,0 +1,17 @@
+#pragma once
+#include "chai3d.h"
+
+// One sample of the experiment, recorded by the haptic thread on every tick
+struct HapticData{
+	double            time;
+	int               trial;		// index of the subexperiment
+	chai3d::cMatrix3d refDiceOrientation;
+	chai3d::cVector3d actDicePos;
+	chai3d::cMatrix3d actDiceOrientation;
+	chai3d::cMatrix3d deviceOrientation;
+	chai3d::cVector3d devicePos;
+	chai3d::cVector3d deviceVel;
+	unsigned int      flags;		// why the sample was logged (HDATA_SAMPLE_* bits, see LogPolicy.h)
+	unsigned long long tick;		// number of the scheduled haptic tick (see HapticScheduler.h)
+	double            matchAngle;	// angle [rad] between the dice and the reference (see OrientationMatch.h)
+};
@@ -0,0 +1,77 @@
+#include "HapticProfiler.h"
+#include <cstdio>
+
+
+HapticProfiler::HapticProfiler()
+{
+	m_loopStart = 0;
+	m_lastMark = 0;
+}
+
+void HapticProfiler::beginLoop()
+{
+	unsigned long long now = latencyNow();
+	if (m_loopStart != 0)
+		m_histograms[PERIOD].record(now - m_loopStart);
+
+	m_loopStart = m_lastMark = now;
+}
+
+void HapticProfiler::mark(Phase phase)
+{
+	unsigned long long now = latencyNow();
+	m_histograms[phase].record(now - m_lastMark);
+	m_lastMark = now;
+}
+
+void HapticProfiler::endLoop()
+{
+	m_histograms[LOOP].record(latencyNow() - m_loopStart);
+}
+
+const char* HapticProfiler::getPhaseName(Phase phase)
+{
+	static const char* names[NUM_PHASES] =
+	{
+		"computeGlobalPositions",
+		"updateFromDevice",
+		"computeInteractionForces",
+		"state machine",
+		"applyToDevice",
+		"match score",
+		"log push",
+		"loop",
+		"period"
+	};
+	return names[phase];
+}
+
+string HapticProfiler::getSummary() const
+{
+	const LatencyHistogram& loop = m_histograms[LOOP];
+	const LatencyHistogram& period = m_histograms[PERIOD];
+
+	char text[256];
+	sprintf(text, "loop p50 %.3f p99 %.3f p99.9 %.3f max %.3f ms, period max %.3f ms",
+		loop.getPercentile(50.0) / 1e6, loop.getPercentile(99.0) / 1e6,
+		loop.getPercentile(99.9) / 1e6, loop.getMax() / 1e6, period.getMax() / 1e6);
+	return text;
+}
+
+void HapticProfiler::printStatistics(ostream& out) const
+{
+	char line[256];
+
+	out << "Haptic loop latency [us]:" << endl;
+	sprintf(line, "  %-26s %12s %10s %10s %10s %10s %10s", "phase", "count", "mean", "p50", "p99", "p99.9", "max");
+	out << line << endl;
+
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		const LatencyHistogram& h = m_histograms[i];
+		sprintf(line, "  %-26s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f", getPhaseName((Phase)i), h.getCount(),
+			h.getMean() / 1e3, h.getPercentile(50.0) / 1e3, h.getPercentile(99.0) / 1e3,
+			h.getPercentile(99.9) / 1e3, h.getMax() / 1e3);
+		out << line << endl;
+	}
+}
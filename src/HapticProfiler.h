@@ -0,0 +1,59 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+// Times the phases of one haptic loop iteration into LatencyHistograms.
+//
+//	profiler.beginLoop();
+//	world->computeGlobalPositions(true);
+//	profiler.mark(HapticProfiler::GLOBAL_POSITIONS);
+//	...
+//	profiler.endLoop();
+//
+// mark() records the time since the previous mark (or beginLoop()) for a
+// phase, so every phase costs one clock read.  Besides the phases, the
+// work time of the whole iteration (LOOP) and the time from the start of
+// one iteration to the start of the next (PERIOD, which includes
+// everything that preempted the thread) are recorded.
+//
+// beginLoop/mark/endLoop belong to the haptic thread; the statistics can
+// be read from any thread (see LatencyHistogram).
+class HapticProfiler
+{
+public:
+	enum Phase
+	{
+		GLOBAL_POSITIONS,	// world->computeGlobalPositions()
+		UPDATE_FROM_DEVICE,	// tool->updateFromDevice()
+		INTERACTION_FORCES,	// tool->computeInteractionForces()
+		STATE_MACHINE,		// selection and start/stop of the experiment
+		APPLY_TO_DEVICE,	// tool->applyToDevice()
+		MATCH_SCORE,		// orientation match of the dice (see OrientationMatch.h)
+		LOG_PUSH,			// filling and logging the sample
+		LOOP,				// one whole iteration
+		PERIOD,				// start of one iteration to the start of the next
+		NUM_PHASES
+	};
+
+public:
+	HapticProfiler();
+
+public:
+	void beginLoop();
+	void mark(Phase phase);
+	void endLoop();
+
+	const LatencyHistogram& getHistogram(Phase phase) const { return m_histograms[phase]; }
+	static const char* getPhaseName(Phase phase);
+
+	string getSummary() const;	// one line about the loop, for a label
+	void printStatistics(ostream& out) const;	// table of all phases
+
+private:
+	LatencyHistogram m_histograms[NUM_PHASES];
+	unsigned long long m_loopStart;
+	unsigned long long m_lastMark;
+};
@@ -0,0 +1,167 @@
+#include "HapticScheduler.h"
+#include "LatencyHistogram.h"
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+
+HapticScheduler::HapticScheduler()
+{
+	m_rate = 0.0;
+	m_waitMode = HYBRID;
+	m_spinTime = 200e-6;
+	m_cpu = -1;
+	m_priority = 0;
+
+	m_period = 0;
+	m_start = 0;
+	m_next = 0;
+	m_timerPeriodSet = false;
+
+	m_ticks.store(0, memory_order_relaxed);
+	m_misses.store(0, memory_order_relaxed);
+	m_skipped.store(0, memory_order_relaxed);
+	m_maxLateness.store(0, memory_order_relaxed);
+}
+
+void HapticScheduler::setupThread()
+{
+#if defined(_WIN32)
+	if (m_cpu >= 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << m_cpu) == 0)
+		cerr << "Warning: The haptic thread could not be pinned to CPU " << m_cpu << "!" << endl;
+
+	if (m_priority > 0 && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+		cerr << "Warning: The priority of the haptic thread could not be raised!" << endl;
+
+	// Sleep() has the resolution of the system timer, 15.6 ms by default
+	if (m_rate > 0.0 && m_waitMode != SPIN)
+		m_timerPeriodSet = (timeBeginPeriod(1) == TIMERR_NOERROR);
+#else
+	if (m_cpu >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(m_cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+			cerr << "Warning: The haptic thread could not be pinned to CPU " << m_cpu << "!" << endl;
+	}
+
+	if (m_priority > 0)
+	{
+		struct sched_param param;
+		param.sched_priority = m_priority;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+			cerr << "Warning: SCHED_FIFO could not be set for the haptic thread (missing CAP_SYS_NICE?)!" << endl;
+	}
+#endif
+}
+
+void HapticScheduler::start()
+{
+	setupThread();
+
+	m_period = m_rate > 0.0 ? (unsigned long long)(1e9 / m_rate + 0.5) : 0;
+	m_start = latencyNow();
+	m_next = 0;
+}
+
+void HapticScheduler::stop()
+{
+#if defined(_WIN32)
+	if (m_timerPeriodSet)
+		timeEndPeriod(1);
+	m_timerPeriodSet = false;
+#endif
+}
+
+void HapticScheduler::waitUntil(unsigned long long deadline)
+{
+	unsigned long long spin = 0;
+	if (m_waitMode == HYBRID)
+		spin = (unsigned long long)(m_spinTime * 1e9);
+
+	if (m_waitMode != SPIN && deadline > spin)
+	{
+		unsigned long long wakeUp = deadline - spin;
+#if defined(_WIN32)
+		unsigned long long now = latencyNow();
+		if (wakeUp > now + 1000000)
+			Sleep((DWORD)((wakeUp - now) / 1000000));
+#else
+		// latencyNow() is CLOCK_MONOTONIC, so the deadline can be used as is
+		struct timespec ts;
+		ts.tv_sec = (time_t)(wakeUp / 1000000000ULL);
+		ts.tv_nsec = (long)(wakeUp % 1000000000ULL);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {}
+#endif
+	}
+
+	while (latencyNow() < deadline)
+	{
+#if defined(_WIN32)
+		YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+	}
+}
+
+unsigned long long HapticScheduler::wait()
+{
+	unsigned long long tick = m_next;
+
+	if (m_period > 0)
+	{
+		unsigned long long deadline = m_start + tick * m_period;
+		unsigned long long now = latencyNow();
+
+		if (now > deadline)
+		{
+			// the previous iteration overran; skip the slots that have passed entirely
+			if (tick > 0)
+				m_misses.store(m_misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+
+			unsigned long long behind = (now - deadline) / m_period;
+			m_skipped.store(m_skipped.load(memory_order_relaxed) + behind, memory_order_relaxed);
+			tick += behind;
+		}
+		else
+		{
+			waitUntil(deadline);
+			now = latencyNow();
+		}
+
+		// lateness against the deadline that was missed, not the slot skipped to
+		if (tick > 0 && now - deadline > m_maxLateness.load(memory_order_relaxed))
+			m_maxLateness.store(now - deadline, memory_order_relaxed);
+	}
+
+	m_next = tick + 1;
+	m_ticks.store(m_ticks.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	return tick;
+}
+
+string HapticScheduler::getSummary() const
+{
+	if (m_rate <= 0.0)
+		return "free-running";
+
+	char text[256];
+	sprintf(text, "%.0f Hz target, %llu missed, %llu skipped, max lateness %.3f ms",
+		m_rate, getMisses(), getSkipped(), getMaxLateness() / 1e6);
+	return text;
+}
+
+void HapticScheduler::printStatistics(ostream& out) const
+{
+	out << "Haptic scheduler: " << getTicks() << " ticks, " << getSummary() << endl;
+}
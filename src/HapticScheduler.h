@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Paces the haptic loop to a fixed period.
+//
+//	scheduler.start();				// on the haptic thread
+//	while (simulationRunning)
+//	{
+//		unsigned long long tick = scheduler.wait();
+//		...
+//	}
+//	scheduler.stop();
+//
+// Tick k is due at start + k * period.  wait() returns once the next tick
+// is due, with the number of that tick, so the samples of the loop carry
+// their place in the schedule and the jitter can be computed offline from
+// the time stamps.  The deadlines are absolute: a late tick does not push
+// the following ones back.  If the loop overran by more than a whole
+// period, the ticks whose slot has passed are skipped (and counted), so
+// the tick number always says which slot the sample belongs to.
+//
+// A tick whose deadline had already passed when the previous iteration
+// finished is a deadline miss.  The lateness (time from the deadline to
+// the return of wait(), overruns and oversleeping alike) is tracked too.
+//
+// With m_rate 0 wait() returns at once and the loop free-runs as before.
+// m_cpu pins the thread to a core, m_priority > 0 switches it to
+// SCHED_FIFO with that priority (on Windows: time critical priority).
+//
+// start/wait/stop belong to the haptic thread; the statistics can be read
+// from any thread.
+class HapticScheduler
+{
+public:
+	enum WaitMode
+	{
+		SLEEP,		// sleep until the deadline (on Windows in whole ms, the rest is spun)
+		SPIN,		// busy wait until the deadline
+		HYBRID		// sleep until m_spinTime before the deadline, then busy wait
+	};
+
+public:
+	double m_rate;			// target rate [Hz] (0: free-running)
+	WaitMode m_waitMode;
+	double m_spinTime;		// busy waiting time [s] at the end of HYBRID waits
+	int m_cpu;				// core the haptic thread is pinned to (-1: no pinning)
+	int m_priority;			// SCHED_FIFO priority (0: leave the priority of the thread)
+
+public:
+	HapticScheduler();
+
+public:
+	void start();	// pin and prioritize the calling thread, tick 0 is due now
+	unsigned long long wait();	// wait for the next tick, returns its number
+	void stop();
+
+	unsigned long long getTicks() const { return m_ticks.load(memory_order_relaxed); }
+	unsigned long long getMisses() const { return m_misses.load(memory_order_relaxed); }
+	unsigned long long getSkipped() const { return m_skipped.load(memory_order_relaxed); }
+	unsigned long long getMaxLateness() const { return m_maxLateness.load(memory_order_relaxed); }	// [ns]
+
+	string getSummary() const;	// one line, for a label
+	void printStatistics(ostream& out) const;
+
+private:
+	void setupThread();
+	void waitUntil(unsigned long long deadline);
+
+	unsigned long long m_period;	// [ns]
+	unsigned long long m_start;
+	unsigned long long m_next;		// number of the next tick
+	bool m_timerPeriodSet;
+
+	atomic<unsigned long long> m_ticks;
+	atomic<unsigned long long> m_misses;
+	atomic<unsigned long long> m_skipped;
+	atomic<unsigned long long> m_maxLateness;
+};
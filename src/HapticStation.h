@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include "chai3d.h"
+#include "DataLogger.h"
+#include "LogPolicy.h"
+#include "HapticProfiler.h"
+#include "HapticScheduler.h"
+#include "SceneSnapshot.h"
+
+using namespace std;
+
+// Everything that belongs to one haptic device: the device, its tool,
+// its own haptic thread (scheduler, profiler, rate) and its own log
+// stream (policy, logger and flushing thread).  The stations share the
+// dice (see GrabArbiter.h) and the trial state.
+//
+// The first station (index 0) owns the haptic world: it is the only one
+// that writes the transforms of its objects.  It runs the trials, moves
+// the reference dice, posts to the trial controller and resets the world.
+// Every other station collides in a world of its own with copies of the
+// actual dice and the virtual button; the copy of the dice follows the
+// pose the first station publishes (diceSnapshot), and a station holding
+// the dice hands the pose it moves it to over to the first station
+// (diceTarget).  The other stations only report whether their tool
+// touches the virtual button, so the trial state has a single writer and
+// needs no locks.
+struct HapticStation
+{
+	int index;
+	chai3d::cGenericHapticDevicePtr device;
+	chai3d::cToolCursor* tool;
+	chai3d::cWorld* world;			// the world the tool collides with
+	chai3d::cMultiMesh* dice;		// the actual dice in that world
+
+	HapticScheduler scheduler;
+	HapticProfiler profiler;
+	chai3d::cFrequencyCounter frequencyCounter;
+
+	LogPolicy logPolicy;
+	DataLogger dataLogger;
+
+	atomic<bool> touchingButton;	// the first contact of the tool is the virtual button
+	atomic<bool> touchingNothing;	// the tool has no contact at all
+	atomic<bool> finished;			// the haptic thread has returned
+
+	seqlock<ToolSnapshot> toolSnapshot;	// pose of the tool for the graphics thread
+
+	HapticStation()
+	{
+		index = 0;
+		tool = 0;
+		world = 0;
+		dice = 0;
+		touchingButton = false;
+		touchingNothing = true;
+		finished = true;
+	}
+};
@@ -0,0 +1,127 @@
+#include "HdataAnalysis.h"
+#include <cmath>
+#include <cstring>
+
+
+TrialAnalyzer::TrialAnalyzer(bool hasTrials)
+{
+	m_hasTrials = hasTrials;
+	m_started = false;
+	m_numTrials = 0;
+	m_lastError = 0.0;
+	memset(&m_last, 0, sizeof(m_last));
+}
+
+bool TrialAnalyzer::isNewTrial(const HdataRecord& previous, const HdataRecord& record) const
+{
+	if (m_hasTrials)
+		return record.trial != previous.trial;
+
+	for (int k = 0; k < 4; k++)
+	{
+		if (record.refDiceQuat[k] != previous.refDiceQuat[k])
+			return true;
+	}
+	return false;
+}
+
+void TrialAnalyzer::add(const HdataRecord* records, size_t count)
+{
+	size_t begin = 0;
+	while (begin < count)
+	{
+		size_t end = begin + 1;
+		while (end < count && !isNewTrial(records[end - 1], records[end]))
+			end++;
+
+		addRun(records + begin, end - begin);
+		begin = end;
+	}
+}
+
+void TrialAnalyzer::addRun(const HdataRecord* records, size_t count)
+{
+	if (!m_started || isNewTrial(m_last, records[0]))
+	{
+		TrialMetrics trial;
+		memset(&trial, 0, sizeof(trial));
+		trial.trial = m_hasTrials ? (unsigned int)records[0].trial : m_numTrials;
+		trial.startTime = records[0].time;
+		m_trials.push_back(trial);
+
+		m_numTrials++;
+		m_started = true;
+
+		// nothing to integrate across the boundary
+		m_last = records[0];
+		const double* a = records[0].actDiceQuat;
+		const double* b = records[0].refDiceQuat;
+		double dot = fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+		m_lastError = 2.0 * acos(dot < 1.0 ? dot : 1.0);
+	}
+
+	// transpose the run, with the last record of the previous run in front
+	size_t n = count + 1;
+	m_x.resize(n); m_y.resize(n); m_z.resize(n);
+	m_t.resize(n); m_error.resize(n); m_speed.resize(n);
+
+	double* x = &m_x[0];
+	double* y = &m_y[0];
+	double* z = &m_z[0];
+	double* t = &m_t[0];
+	double* error = &m_error[0];
+	double* speed = &m_speed[0];
+
+	x[0] = m_last.actDicePos[0]; y[0] = m_last.actDicePos[1]; z[0] = m_last.actDicePos[2];
+	t[0] = m_last.time;
+	error[0] = m_lastError;
+	speed[0] = 0.0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const HdataRecord& r = records[i];
+		x[i + 1] = r.actDicePos[0];
+		y[i + 1] = r.actDicePos[1];
+		z[i + 1] = r.actDicePos[2];
+		t[i + 1] = r.time;
+
+		// |cos(angle / 2)| between the two orientations; q and -q are the same rotation
+		double dot = r.actDiceQuat[0] * r.refDiceQuat[0] + r.actDiceQuat[1] * r.refDiceQuat[1]
+			+ r.actDiceQuat[2] * r.refDiceQuat[2] + r.actDiceQuat[3] * r.refDiceQuat[3];
+		error[i + 1] = fabs(dot);
+
+		speed[i + 1] = r.deviceVel[0] * r.deviceVel[0] + r.deviceVel[1] * r.deviceVel[1] + r.deviceVel[2] * r.deviceVel[2];
+	}
+
+	for (size_t i = 1; i < n; i++)
+		error[i] = 2.0 * acos(error[i] < 1.0 ? error[i] : 1.0);
+
+	double path = 0.0;
+	for (size_t i = 1; i < n; i++)
+	{
+		double dx = x[i] - x[i - 1], dy = y[i] - y[i - 1], dz = z[i] - z[i - 1];
+		path += sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	// trapezoidal rule
+	double integral = 0.0;
+	for (size_t i = 1; i < n; i++)
+		integral += 0.5 * (error[i] + error[i - 1]) * (t[i] - t[i - 1]);
+
+	double peak = 0.0;
+	for (size_t i = 1; i < n; i++)
+		peak = speed[i] > peak ? speed[i] : peak;
+
+	TrialMetrics& trial = m_trials.back();
+	trial.samples += count;
+	trial.completionTime = records[count - 1].time - trial.startTime;
+	trial.pathLength += path;
+	trial.integratedOrientationError += integral;
+	trial.finalOrientationError = error[count];
+	peak = sqrt(peak);
+	if (peak > trial.peakVelocity)
+		trial.peakVelocity = peak;
+
+	m_last = records[count - 1];
+	m_lastError = error[count];
+}
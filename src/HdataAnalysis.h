@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include "HdataFormat.h"
+
+using namespace std;
+
+// Results of one trial
+struct TrialMetrics
+{
+	unsigned int trial;
+	unsigned long long samples;
+	double startTime;					// [s]
+	double completionTime;				// time from the first to the last sample [s]
+	double pathLength;					// distance travelled by the manipulated dice [m]
+	double finalOrientationError;		// angle between the manipulated and the reference dice at the end [rad]
+	double integratedOrientationError;	// integral of that angle over the trial [rad s]
+	double peakVelocity;				// largest speed of the haptic device [m/s]
+};
+
+// Computes TrialMetrics in a single pass over a stream of records.
+//
+// Records are fed in batches (as they come out of HdataReader::next()).
+// Each batch is split at trial boundaries and every run is transposed
+// into contiguous arrays first, so that the per-sample math is a set of
+// plain loops over doubles the compiler can vectorize.  Trials are
+// delimited by the trial field, or for files without one by a change
+// of the reference orientation.
+class TrialAnalyzer
+{
+public:
+	TrialAnalyzer(bool hasTrials);
+
+public:
+	void add(const HdataRecord* records, size_t count);
+	const vector<TrialMetrics>& getTrials() const { return m_trials; }
+
+private:
+	bool isNewTrial(const HdataRecord& previous, const HdataRecord& record) const;
+	void addRun(const HdataRecord* records, size_t count);
+
+	bool m_hasTrials;
+	bool m_started;
+	unsigned int m_numTrials;		// for files without a trial field
+	HdataRecord m_last;				// last record of the previous run
+	double m_lastError;
+	vector<TrialMetrics> m_trials;
+
+	// per-run scratch arrays
+	vector<double> m_x, m_y, m_z, m_t, m_error, m_speed;
+};
@@ -0,0 +1,115 @@
+#include "HdataCodec.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+
+static inline long long quantize(double v, double quantum)
+{
+	if (quantum > 0.0)
+		return (long long)floor(v / quantum + 0.5);
+
+	long long bits;
+	memcpy(&bits, &v, 8);
+	return bits;
+}
+
+static inline double dequantize(long long q, double quantum)
+{
+	if (quantum > 0.0)
+		return q * quantum;
+
+	double v;
+	memcpy(&v, &q, 8);
+	return v;
+}
+
+
+HdataCodec::HdataCodec()
+{
+	m_header = 0;
+}
+
+void HdataCodec::setup(const HdataHeader& header)
+{
+	m_header = &header;
+	m_quanta.clear();
+
+	for (size_t i = 0; i < header.m_fields.size(); i++)
+	{
+		for (int c = 0; c < header.m_fields[i].count; c++)
+			m_quanta.push_back(header.m_fields[i].quantum);
+	}
+
+	m_values.resize(m_quanta.size());
+	m_previous.resize(m_quanta.size());
+}
+
+size_t HdataCodec::getMaxEncodedSize(size_t count) const
+{
+	// a 64-bit varint takes at most 10 bytes
+	return HDATA_BLOCK_HEADER_SIZE + count * m_quanta.size() * 10;
+}
+
+size_t HdataCodec::encodeBlock(const HdataRecord* records, size_t count, unsigned char* out)
+{
+	size_t n = m_quanta.size();
+	unsigned char* p = out + HDATA_BLOCK_HEADER_SIZE;
+
+	fill(m_previous.begin(), m_previous.end(), 0);
+
+	for (size_t r = 0; r < count; r++)
+	{
+		m_header->gather(records[r], &m_values[0]);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			long long q = quantize(m_values[i], m_quanta[i]);
+			p = hdataPutVarint(p, (long long)((unsigned long long)q - (unsigned long long)m_previous[i]));
+			m_previous[i] = q;
+		}
+	}
+
+	size_t payload = p - out - HDATA_BLOCK_HEADER_SIZE;
+	hdataPutU32(out, (unsigned int)count);
+	hdataPutU32(out + 4, (unsigned int)payload);
+
+	return p - out;
+}
+
+size_t HdataCodec::decodeBlock(const unsigned char* in, size_t size, vector<HdataRecord>& out)
+{
+	if (size < HDATA_BLOCK_HEADER_SIZE)
+		return 0;
+
+	size_t count = hdataGetU32(in);
+	size_t payload = hdataGetU32(in + 4);
+	if (payload > size - HDATA_BLOCK_HEADER_SIZE)
+		return 0;
+
+	size_t n = m_quanta.size();
+	const unsigned char* p = in + HDATA_BLOCK_HEADER_SIZE;
+	const unsigned char* end = p + payload;
+
+	fill(m_previous.begin(), m_previous.end(), 0);
+
+	HdataRecord record;
+	for (size_t r = 0; r < count; r++)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			long long delta;
+			p = hdataGetVarint(p, end, delta);
+			if (p == 0)
+				return 0;
+
+			m_previous[i] = (long long)((unsigned long long)m_previous[i] + (unsigned long long)delta);
+			m_values[i] = dequantize(m_previous[i], m_quanta[i]);
+		}
+
+		m_header->scatter(&m_values[0], record);
+		out.push_back(record);
+	}
+
+	return HDATA_BLOCK_HEADER_SIZE + payload;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include "HdataFormat.h"
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+// Delta + varint coding of blocks of records (HDATA_FLAG_DELTA files)
+//
+// Consecutive samples are strongly correlated (refDiceOrientation is
+// constant for a whole trial, positions change by tiny steps per tick),
+// so every scalar value is quantized with the step of its field,
+// replaced by its difference to the previous sample of the block and
+// stored as a zigzag varint.  Most differences then fit in one byte.
+//
+// Each block is self-contained, so a reader can start at any block:
+//
+//   u32  number of records
+//   u32  size of the payload in bytes
+//   ...  payload: per record, per scalar value in schema order, the
+//        zigzag varint of the quantized difference to the previous record
+//        (the first record of a block is coded against zero)
+//
+// Decoding is exact up to half a quantization step.  A step of 0 stores
+// the raw bits of the f64 value instead, which is lossless.
+//------------------------------------------------------------------------------
+
+#define HDATA_BLOCK_HEADER_SIZE 8
+
+// zigzag varint of v at p; returns the end of the code (at most 10 bytes)
+inline unsigned char* hdataPutVarint(unsigned char* p, long long v)
+{
+	// zigzag: small negative and positive numbers both get small codes
+	unsigned long long u = ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+
+	while (u >= 0x80)
+	{
+		*p++ = (unsigned char)(u | 0x80);
+		u >>= 7;
+	}
+	*p++ = (unsigned char)u;
+	return p;
+}
+
+// reads a zigzag varint; returns the end of the code, or 0 if it runs past end
+inline const unsigned char* hdataGetVarint(const unsigned char* p, const unsigned char* end, long long& v)
+{
+	unsigned long long u = 0;
+	int shift = 0;
+
+	while (p < end && shift < 64)
+	{
+		unsigned char b = *p++;
+		u |= (unsigned long long)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+		{
+			v = (long long)(u >> 1) ^ -(long long)(u & 1);
+			return p;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+class HdataCodec
+{
+public:
+	HdataCodec();
+
+public:
+	void setup(const HdataHeader& header);	// take the fields and quantization steps from a header
+
+	size_t getMaxEncodedSize(size_t count) const;	// worst-case size of a block of count records
+
+	// encodes count records into out (at least getMaxEncodedSize(count) bytes); returns the block size
+	size_t encodeBlock(const HdataRecord* records, size_t count, unsigned char* out);
+
+	// decodes the block at in and appends its records to out; returns the
+	// block size, or 0 if the block is truncated or corrupt
+	size_t decodeBlock(const unsigned char* in, size_t size, vector<HdataRecord>& out);
+
+private:
+	const HdataHeader* m_header;
+	vector<double> m_quanta;	// per scalar value
+	vector<double> m_values;
+	vector<long long> m_previous;
+};
@@ -0,0 +1,499 @@
+#include "HdataFormat.h"
+#include <cstring>
+
+
+// fields this version knows about, and where they live in HdataRecord
+struct HdataKnownField
+{
+	const char* name;
+	size_t offset;			// offset in HdataRecord [bytes]
+	unsigned char count;
+	unsigned char type;		// HDATA_F32 means f32 in float32 files and f64 otherwise
+};
+
+static const HdataKnownField knownFields[] =
+{
+	{ "time",               offsetof(HdataRecord, time),        1, HDATA_F64 },
+	{ "trial",              offsetof(HdataRecord, trial),       1, HDATA_U32 },
+	{ "refDiceOrientation", offsetof(HdataRecord, refDiceQuat), 4, HDATA_F32 },
+	{ "actDicePos",         offsetof(HdataRecord, actDicePos),  3, HDATA_F32 },
+	{ "actDiceOrientation", offsetof(HdataRecord, actDiceQuat), 4, HDATA_F32 },
+	{ "deviceOrientation",  offsetof(HdataRecord, deviceQuat),  4, HDATA_F32 },
+	{ "devicePos",          offsetof(HdataRecord, devicePos),   3, HDATA_F32 },
+	{ "deviceVel",          offsetof(HdataRecord, deviceVel),   3, HDATA_F32 },
+	{ "flags",              offsetof(HdataRecord, flags),       1, HDATA_U32 },
+	{ "tick",               offsetof(HdataRecord, tick),        1, HDATA_U64 },
+	{ "matchAngle",         offsetof(HdataRecord, matchAngle),  1, HDATA_F32 },
+};
+
+static const int numKnownFields = sizeof(knownFields) / sizeof(knownFields[0]);
+
+// the byte order of the file is the native one on x86/x64 (and little-endian
+// ARM), where the helpers below can use plain loads and stores
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__) || \
+	(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define HDATA_NATIVE_LITTLE_ENDIAN
+#endif
+
+static const char magic[8] = { 'D', 'I', 'C', 'E', 'H', 'D', 'A', 'T' };
+static const char indexMagic[8] = { 'D', 'I', 'C', 'E', 'H', 'I', 'D', 'X' };
+
+
+HdataHeader::HdataHeader()
+{
+	m_version = HDATA_VERSION;
+	m_flags = 0;
+	m_headerSize = 0;
+	m_recordSize = 0;
+	m_sampleRate = 0.0;
+	m_sampleCount = 0;
+	m_configHash = 0;
+}
+
+void HdataHeader::setSchema(bool float32)
+{
+	m_version = HDATA_VERSION;
+	m_flags = float32 ? HDATA_FLAG_FLOAT32 : 0;
+	m_fields.clear();
+
+	for (int i = 0; i < numKnownFields; i++)
+	{
+		HdataField field;
+		field.name = knownFields[i].name;
+		field.type = knownFields[i].type;
+		if (field.type == HDATA_F32 && !float32)
+			field.type = HDATA_F64;
+		field.count = knownFields[i].count;
+		field.quantum = 0.0;
+		m_fields.push_back(field);
+	}
+
+	mapFields();
+}
+
+void HdataHeader::setDeltaSchema(double precision)
+{
+	setSchema(false);
+	m_flags = HDATA_FLAG_DELTA;
+
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		if (m_fields[i].type == HDATA_U32 || m_fields[i].type == HDATA_U64)
+			m_fields[i].quantum = 1.0;
+		else if (m_fields[i].name == "time")
+			m_fields[i].quantum = 1e-6;
+		else
+			m_fields[i].quantum = precision;
+	}
+}
+
+void HdataHeader::mapFields()
+{
+	m_fieldIndex.assign(m_fields.size(), -1);
+	m_runs.clear();
+	m_recordSize = 0;
+
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		for (int k = 0; k < numKnownFields; k++)
+		{
+			if (m_fields[i].name == knownFields[k].name)
+				m_fieldIndex[i] = k;
+		}
+
+		// merge the components into runs, so that decode() can copy most
+		// of a record with a few memcpy calls
+		for (int c = 0; c < m_fields[i].count; c++)
+		{
+			int value = -1;
+			if (m_fieldIndex[i] >= 0 && c < knownFields[m_fieldIndex[i]].count)
+				value = (int)(knownFields[m_fieldIndex[i]].offset / sizeof(double)) + c;
+
+			Run* last = m_runs.empty() ? 0 : &m_runs.back();
+			if (last != 0 && last->type == m_fields[i].type &&
+				(value < 0 ? last->value < 0 : last->value >= 0 && last->value + (int)last->count == value))
+			{
+				last->count++;
+			}
+			else
+			{
+				Run run = { m_recordSize, value, m_fields[i].type, 1 };
+				m_runs.push_back(run);
+			}
+			m_recordSize += (unsigned int)hdataTypeSize(m_fields[i].type);
+		}
+	}
+}
+
+void HdataHeader::write(vector<unsigned char>& out)
+{
+	size_t size = 50 + m_participantID.size();
+	for (size_t i = 0; i < m_fields.size(); i++)
+		size += 11 + m_fields[i].name.size();
+
+	mapFields();
+	m_headerSize = (unsigned int)size;
+
+	out.assign(size, 0);
+	unsigned char* p = &out[0];
+
+	memcpy(p, magic, 8);
+	hdataPutU16(p + 8, m_version);
+	hdataPutU16(p + 10, m_flags);
+	hdataPutU32(p + 12, m_headerSize);
+	hdataPutU32(p + 16, m_recordSize);
+	hdataPutU32(p + 20, (unsigned int)m_fields.size());
+	hdataPutF64(p + HDATA_OFFSET_SAMPLE_RATE, m_sampleRate);
+	hdataPutU64(p + HDATA_OFFSET_SAMPLE_COUNT, m_sampleCount);
+	hdataPutU64(p + 40, m_configHash);
+	hdataPutU16(p + 48, (unsigned short)m_participantID.size());
+	memcpy(p + 50, m_participantID.data(), m_participantID.size());
+
+	p += 50 + m_participantID.size();
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		*p++ = (unsigned char)m_fields[i].name.size();
+		memcpy(p, m_fields[i].name.data(), m_fields[i].name.size());
+		p += m_fields[i].name.size();
+		*p++ = m_fields[i].type;
+		*p++ = m_fields[i].count;
+		hdataPutF64(p, m_fields[i].quantum);
+		p += 8;
+	}
+}
+
+bool HdataHeader::read(const unsigned char* data, size_t size)
+{
+	if (size < 50 || memcmp(data, magic, 8) != 0)
+		return false;
+
+	m_version = hdataGetU16(data + 8);
+	m_flags = hdataGetU16(data + 10);
+	m_headerSize = hdataGetU32(data + 12);
+	unsigned int recordSize = hdataGetU32(data + 16);
+	unsigned int numFields = hdataGetU32(data + 20);
+	m_sampleRate = hdataGetF64(data + HDATA_OFFSET_SAMPLE_RATE);
+	m_sampleCount = hdataGetU64(data + HDATA_OFFSET_SAMPLE_COUNT);
+	m_configHash = hdataGetU64(data + 40);
+
+	size_t idLength = hdataGetU16(data + 48);
+	if (m_headerSize > size || 50 + idLength > m_headerSize)
+		return false;
+	m_participantID.assign((const char*)data + 50, idLength);
+
+	const unsigned char* p = data + 50 + idLength;
+	const unsigned char* end = data + m_headerSize;
+
+	m_fields.clear();
+	size_t quantumSize = (m_version >= 2) ? 8 : 0;
+
+	for (unsigned int i = 0; i < numFields; i++)
+	{
+		if (p >= end || p + 1 + *p + 2 + quantumSize > end)
+			return false;
+
+		HdataField field;
+		field.name.assign((const char*)p + 1, *p);
+		p += 1 + *p;
+		field.type = *p++;
+		field.count = *p++;
+		field.quantum = quantumSize ? hdataGetF64(p) : 0.0;
+		p += quantumSize;
+
+		if (hdataTypeSize(field.type) == 0)
+			return false;
+		m_fields.push_back(field);
+	}
+
+	mapFields();
+
+	// delta coded files give the size of a decoded f64 record instead
+	if (m_flags & HDATA_FLAG_DELTA)
+		return true;
+	return m_recordSize == recordSize;
+}
+
+size_t HdataHeader::encode(const HdataRecord& record, unsigned char* out) const
+{
+	unsigned char* p = out;
+
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		const double* src = 0;
+		if (m_fieldIndex[i] >= 0)
+			src = (const double*)((const char*)&record + knownFields[m_fieldIndex[i]].offset);
+
+		for (int c = 0; c < m_fields[i].count; c++)
+		{
+			double v = (src != 0 && c < knownFields[m_fieldIndex[i]].count) ? src[c] : 0.0;
+
+			switch (m_fields[i].type)
+			{
+			case HDATA_F64: hdataPutF64(p, v); p += 8; break;
+			case HDATA_F32: hdataPutF32(p, (float)v); p += 4; break;
+			case HDATA_U32: hdataPutU32(p, (unsigned int)v); p += 4; break;
+			case HDATA_U64: hdataPutU64(p, (unsigned long long)v); p += 8; break;
+			}
+		}
+	}
+
+	return p - out;
+}
+
+void HdataHeader::decode(const unsigned char* in, HdataRecord& record) const
+{
+	double* values = (double*)&record;
+
+	memset(&record, 0, sizeof(record));
+
+	for (size_t r = 0; r < m_runs.size(); r++)
+	{
+		const Run& run = m_runs[r];
+		if (run.value < 0)
+			continue;
+
+		const unsigned char* p = in + run.offset;
+		double* dst = values + run.value;
+
+		switch (run.type)
+		{
+		case HDATA_F64:
+#if defined(HDATA_NATIVE_LITTLE_ENDIAN)
+			memcpy(dst, p, 8 * run.count);
+#else
+			for (size_t c = 0; c < run.count; c++)
+				dst[c] = hdataGetF64(p + 8 * c);
+#endif
+			break;
+		case HDATA_F32:
+			for (size_t c = 0; c < run.count; c++)
+				dst[c] = hdataGetF32(p + 4 * c);
+			break;
+		case HDATA_U32:
+			for (size_t c = 0; c < run.count; c++)
+				dst[c] = hdataGetU32(p + 4 * c);
+			break;
+		case HDATA_U64:
+			for (size_t c = 0; c < run.count; c++)
+				dst[c] = (double)hdataGetU64(p + 8 * c);
+			break;
+		}
+	}
+}
+
+size_t HdataHeader::getNumValues() const
+{
+	size_t n = 0;
+	for (size_t i = 0; i < m_fields.size(); i++)
+		n += m_fields[i].count;
+	return n;
+}
+
+void HdataHeader::gather(const HdataRecord& record, double* values) const
+{
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		const double* src = 0;
+		if (m_fieldIndex[i] >= 0)
+			src = (const double*)((const char*)&record + knownFields[m_fieldIndex[i]].offset);
+
+		for (int c = 0; c < m_fields[i].count; c++)
+			*values++ = (src != 0 && c < knownFields[m_fieldIndex[i]].count) ? src[c] : 0.0;
+	}
+}
+
+void HdataHeader::scatter(const double* values, HdataRecord& record) const
+{
+	memset(&record, 0, sizeof(record));
+
+	for (size_t i = 0; i < m_fields.size(); i++)
+	{
+		double* dst = 0;
+		if (m_fieldIndex[i] >= 0)
+			dst = (double*)((char*)&record + knownFields[m_fieldIndex[i]].offset);
+
+		for (int c = 0; c < m_fields[i].count; c++, values++)
+		{
+			if (dst != 0 && c < knownFields[m_fieldIndex[i]].count)
+				dst[c] = *values;
+		}
+	}
+}
+
+void hdataWriteIndex(const vector<HdataTrialIndex>& index, unsigned long long indexOffset, vector<unsigned char>& out)
+{
+	out.assign(index.size() * HDATA_INDEX_ENTRY_SIZE + HDATA_TRAILER_SIZE, 0);
+	unsigned char* p = &out[0];
+
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		hdataPutU32(p, index[i].trial);
+		hdataPutU64(p + 4, index[i].offset);
+		hdataPutU64(p + 12, index[i].sampleCount);
+		hdataPutF64(p + 20, index[i].startTime);
+		hdataPutF64(p + 28, index[i].endTime);
+		for (int k = 0; k < 4; k++)
+			hdataPutF64(p + 36 + 8 * k, index[i].rotation[k]);
+		p += HDATA_INDEX_ENTRY_SIZE;
+	}
+
+	hdataPutU64(p, indexOffset);
+	hdataPutU32(p + 8, (unsigned int)index.size());
+	memcpy(p + 12, indexMagic, 8);
+}
+
+bool hdataReadIndex(const unsigned char* data, size_t size, size_t headerSize, vector<HdataTrialIndex>& index, unsigned long long& indexOffset)
+{
+	index.clear();
+	if (size < HDATA_TRAILER_SIZE)
+		return false;
+
+	const unsigned char* trailer = data + size - HDATA_TRAILER_SIZE;
+	if (memcmp(trailer + 12, indexMagic, 8) != 0)
+		return false;
+
+	// the trailer may be corrupt: check each term against the size, so
+	// that nothing wraps around
+	indexOffset = hdataGetU64(trailer);
+	size_t count = hdataGetU32(trailer + 8);
+	if (count > (size - HDATA_TRAILER_SIZE) / HDATA_INDEX_ENTRY_SIZE ||
+		indexOffset != size - HDATA_TRAILER_SIZE - count * HDATA_INDEX_ENTRY_SIZE || indexOffset < headerSize)
+		return false;
+
+	const unsigned char* p = data + indexOffset;
+	unsigned long long previous = headerSize;
+	for (size_t i = 0; i < count; i++)
+	{
+		HdataTrialIndex entry;
+		entry.trial = hdataGetU32(p);
+		entry.offset = hdataGetU64(p + 4);
+		entry.sampleCount = hdataGetU64(p + 12);
+		entry.startTime = hdataGetF64(p + 20);
+		entry.endTime = hdataGetF64(p + 28);
+		for (int k = 0; k < 4; k++)
+			entry.rotation[k] = hdataGetF64(p + 36 + 8 * k);
+
+		// the trials follow each other between the header and the index
+		if (entry.offset < previous || entry.offset > indexOffset)
+		{
+			index.clear();
+			return false;
+		}
+		previous = entry.offset;
+		index.push_back(entry);
+		p += HDATA_INDEX_ENTRY_SIZE;
+	}
+	return true;
+}
+
+size_t hdataTypeSize(unsigned char type)
+{
+	switch (type)
+	{
+	case HDATA_F64: return 8;
+	case HDATA_F32: return 4;
+	case HDATA_U32: return 4;
+	case HDATA_U64: return 8;
+	}
+	return 0;
+}
+
+unsigned long long hdataHash(const void* data, size_t size, unsigned long long hash)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+void hdataPutU16(unsigned char* p, unsigned short v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+void hdataPutU32(unsigned char* p, unsigned int v)
+{
+#if defined(HDATA_NATIVE_LITTLE_ENDIAN)
+	memcpy(p, &v, 4);
+#else
+	for (int i = 0; i < 4; i++)
+		p[i] = (unsigned char)(v >> (8 * i));
+#endif
+}
+
+void hdataPutU64(unsigned char* p, unsigned long long v)
+{
+#if defined(HDATA_NATIVE_LITTLE_ENDIAN)
+	memcpy(p, &v, 8);
+#else
+	for (int i = 0; i < 8; i++)
+		p[i] = (unsigned char)(v >> (8 * i));
+#endif
+}
+
+void hdataPutF64(unsigned char* p, double v)
+{
+	unsigned long long bits;
+	memcpy(&bits, &v, 8);
+	hdataPutU64(p, bits);
+}
+
+void hdataPutF32(unsigned char* p, float v)
+{
+	unsigned int bits;
+	memcpy(&bits, &v, 4);
+	hdataPutU32(p, bits);
+}
+
+unsigned short hdataGetU16(const unsigned char* p)
+{
+	return (unsigned short)(p[0] | (p[1] << 8));
+}
+
+unsigned int hdataGetU32(const unsigned char* p)
+{
+#if defined(HDATA_NATIVE_LITTLE_ENDIAN)
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+#else
+	unsigned int v = 0;
+	for (int i = 3; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+#endif
+}
+
+unsigned long long hdataGetU64(const unsigned char* p)
+{
+#if defined(HDATA_NATIVE_LITTLE_ENDIAN)
+	unsigned long long v;
+	memcpy(&v, p, 8);
+	return v;
+#else
+	unsigned long long v = 0;
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+#endif
+}
+
+double hdataGetF64(const unsigned char* p)
+{
+	unsigned long long bits = hdataGetU64(p);
+	double v;
+	memcpy(&v, &bits, 8);
+	return v;
+}
+
+float hdataGetF32(const unsigned char* p)
+{
+	unsigned int bits = hdataGetU32(p);
+	float v;
+	memcpy(&v, &bits, 4);
+	return v;
+}
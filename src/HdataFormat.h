@@ -0,0 +1,192 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+// Binary format of the .hdata files written by DataLogger
+//
+// All values are little-endian and packed, independent of the compiler
+// that wrote them.  A file starts with a header:
+//
+//   offset  size  content
+//   0       8     magic "DICEHDAT"
+//   8       2     format version (HDATA_VERSION)
+//   10      2     flags (HDATA_FLAG_*)
+//   12      4     header size in bytes (records start here)
+//   16      4     record size in bytes
+//   20      4     number of fields in the schema
+//   24      8     mean sample rate [Hz] (f64, filled in when the file is closed)
+//   32      8     number of records (u64, filled in when the file is closed)
+//   40      8     hash of the experiment configuration (u64)
+//   48      2+n   participant ID (u16 length + characters)
+//   ...           schema: per field u8 name length, name, u8 type, u8 count,
+//                 f64 quantization step (version 2 and later)
+//
+// followed by fixed-size records laid out as the schema describes.
+// Orientations are stored as unit quaternions (w, x, y, z).
+//
+// If HDATA_FLAG_INDEX is set, the records are followed by a trial index
+// (version 3 and later):
+//
+//   per trial (HDATA_INDEX_ENTRY_SIZE bytes):
+//     u32 trial, u64 byte offset of its first record (or delta block),
+//     u64 number of records, f64 time of the first and of the last record,
+//     f64 x 4 rotation of the reference dice for the trial (axis x, y, z, angle [rad])
+//   trailer (HDATA_TRAILER_SIZE bytes):
+//     u64 offset of the index, u32 number of trials, magic "DICEHIDX"
+//
+// so that a reader can find any trial from the end of the file.  Every
+// trial starts with a new delta block, so delta coded trials can be
+// decoded on their own.
+//
+// If HDATA_FLAG_DELTA is set, the records are instead grouped in delta
+// coded blocks (see HdataCodec.h); the record size is then the size of
+// a decoded f64 record.
+//
+// Files without the magic are version 0: a raw dump of the in-memory
+// HapticData struct of the MSVC x64 build (296 bytes per sample).
+//------------------------------------------------------------------------------
+
+#define HDATA_VERSION 3
+
+// the record values are stored as f32 instead of f64 (time is always f64)
+#define HDATA_FLAG_FLOAT32 0x0001
+
+// the records are stored as delta coded blocks
+#define HDATA_FLAG_DELTA 0x0002
+
+// the file ends with a trial index
+#define HDATA_FLAG_INDEX 0x0004
+
+// bits of the per-record "flags" field: why the sample was logged (see LogPolicy.h)
+#define HDATA_SAMPLE_SELECTION  0x0001	// the dice is being manipulated (full rate)
+#define HDATA_SAMPLE_CONTACT    0x0002	// the tool touches the virtual button (full rate)
+#define HDATA_SAMPLE_TRANSITION 0x0004	// first sample after a change of state or trial
+#define HDATA_SAMPLE_IDLE       0x0008	// decimated idle sample
+#define HDATA_SAMPLE_CHANGE     0x0010	// idle sample that moved more than the threshold
+#define HDATA_SAMPLE_ALL        0x0020	// every tick is logged (adaptive logging off)
+
+#define HDATA_INDEX_ENTRY_SIZE 68
+#define HDATA_TRAILER_SIZE 20
+
+// offsets of the fields that are patched when the file is closed
+#define HDATA_OFFSET_SAMPLE_RATE 24
+#define HDATA_OFFSET_SAMPLE_COUNT 32
+
+// size of a version 0 record
+#define HDATA_LEGACY_RECORD_SIZE 296
+
+enum HdataType
+{
+	HDATA_F64 = 1,
+	HDATA_F32 = 2,
+	HDATA_U32 = 3,
+	HDATA_U64 = 4
+};
+
+struct HdataField
+{
+	string name;
+	unsigned char type;		// HdataType
+	unsigned char count;	// number of components
+	double quantum;			// quantization step of delta coded files (0 = not quantized)
+};
+
+// One sample, independent of chai3d and of the on-disk precision
+struct HdataRecord
+{
+	double time;			// time since the start of the trial [s]
+	double trial;			// index of the subexperiment (stored as u32)
+	double refDiceQuat[4];	// orientation of the reference dice (w, x, y, z)
+	double actDicePos[3];	// position of the manipulated dice
+	double actDiceQuat[4];	// orientation of the manipulated dice (w, x, y, z)
+	double deviceQuat[4];	// orientation of the haptic device (w, x, y, z)
+	double devicePos[3];	// position of the haptic device
+	double deviceVel[3];	// linear velocity of the haptic device
+	double flags;			// HDATA_SAMPLE_* bits (stored as u32)
+	double tick;			// number of the scheduled haptic tick (stored as u64)
+	double matchAngle;		// angle between the manipulated and the reference dice [rad]
+};
+
+// Entry of the trial index at the end of the file
+struct HdataTrialIndex
+{
+	unsigned int trial;
+	unsigned long long offset;
+	unsigned long long sampleCount;
+	double startTime;
+	double endTime;
+	double rotation[4];
+};
+
+class HdataHeader
+{
+public:
+	unsigned short m_version;
+	unsigned short m_flags;
+	unsigned int m_headerSize;
+	unsigned int m_recordSize;
+	double m_sampleRate;
+	unsigned long long m_sampleCount;
+	unsigned long long m_configHash;
+	string m_participantID;
+	vector<HdataField> m_fields;
+
+public:
+	HdataHeader();
+
+public:
+	void setSchema(bool float32);	// schema of the records written by this version
+	void setDeltaSchema(double precision);	// schema of delta coded files, with the given quantization step
+	void write(vector<unsigned char>& out);	// serialize (also computes m_headerSize and m_recordSize)
+	bool read(const unsigned char* data, size_t size);	// parse; false if this is not a valid header
+
+	size_t encode(const HdataRecord& record, unsigned char* out) const;	// returns the number of bytes written
+	void decode(const unsigned char* in, HdataRecord& record) const;	// fields unknown to this version are skipped
+
+	size_t getNumValues() const;	// number of scalar values per record
+	void gather(const HdataRecord& record, double* values) const;	// record -> scalar values in schema order
+	void scatter(const double* values, HdataRecord& record) const;	// scalar values in schema order -> record
+
+private:
+	// run of consecutive values of the same type that are also consecutive in HdataRecord
+	struct Run
+	{
+		size_t offset;			// in the encoded record [bytes]
+		int value;				// index of the first double in HdataRecord (-1 if unknown)
+		unsigned char type;
+		size_t count;
+	};
+
+	vector<int> m_fieldIndex;	// per schema field: index into the known field table (-1 if unknown)
+	vector<Run> m_runs;			// decoding plan
+	void mapFields();
+};
+
+// serialize the trial index and trailer; indexOffset is where out will be written
+void hdataWriteIndex(const vector<HdataTrialIndex>& index, unsigned long long indexOffset, vector<unsigned char>& out);
+
+// find and parse the trial index of a whole file whose header is headerSize
+// bytes; false if it has none or it does not fit the file
+bool hdataReadIndex(const unsigned char* data, size_t size, size_t headerSize, vector<HdataTrialIndex>& index, unsigned long long& indexOffset);
+
+// size in bytes of one component of a field type
+size_t hdataTypeSize(unsigned char type);
+
+// 64-bit FNV-1a hash, used for the configuration hash
+unsigned long long hdataHash(const void* data, size_t size, unsigned long long hash = 14695981039346656037ULL);
+
+// little-endian helpers shared by the writers and readers
+void hdataPutU16(unsigned char* p, unsigned short v);
+void hdataPutU32(unsigned char* p, unsigned int v);
+void hdataPutU64(unsigned char* p, unsigned long long v);
+void hdataPutF64(unsigned char* p, double v);
+void hdataPutF32(unsigned char* p, float v);
+unsigned short hdataGetU16(const unsigned char* p);
+unsigned int hdataGetU32(const unsigned char* p);
+unsigned long long hdataGetU64(const unsigned char* p);
+double hdataGetF64(const unsigned char* p);
+float hdataGetF32(const unsigned char* p);
@@ -0,0 +1,291 @@
+#include "HdataReader.h"
+#include <cmath>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+HdataReader::HdataReader()
+{
+	m_data = 0;
+	m_fileSize = 0;
+	m_dataEnd = 0;
+	m_pos = 0;
+	m_end = 0;
+	m_legacy = false;
+
+#if defined(_WIN32)
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#else
+	m_file = -1;
+#endif
+}
+
+HdataReader::~HdataReader()
+{
+	close();
+}
+
+bool HdataReader::open(const string& fileName)
+{
+	close();
+	m_error = "";
+
+#if defined(_WIN32)
+	m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return fail("cannot open " + fileName);
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+		return fail("cannot get the size of " + fileName);
+	m_fileSize = size.QuadPart;
+
+	if (m_fileSize > 0)
+	{
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping == NULL)
+			return fail("cannot map " + fileName);
+		m_data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	m_file = ::open(fileName.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return fail("cannot open " + fileName);
+
+	struct stat st;
+	if (fstat(m_file, &st) != 0)
+		return fail("cannot get the size of " + fileName);
+	m_fileSize = st.st_size;
+
+	if (m_fileSize > 0)
+	{
+		void* p = mmap(0, (size_t)m_fileSize, PROT_READ, MAP_PRIVATE, m_file, 0);
+		if (p != MAP_FAILED)
+		{
+			// the file is read front to back once: read ahead aggressively, drop pages behind
+			madvise(p, (size_t)m_fileSize, MADV_SEQUENTIAL);
+			m_data = (const unsigned char*)p;
+		}
+	}
+#endif
+
+	if (m_data == 0)
+		return fail("cannot map " + fileName);
+
+	if (m_header.read(m_data, (size_t)m_fileSize))
+	{
+		m_legacy = false;
+
+		unsigned long long indexOffset;
+		if ((m_header.m_flags & HDATA_FLAG_INDEX) && hdataReadIndex(m_data, (size_t)m_fileSize, m_header.m_headerSize, m_index, indexOffset))
+			m_dataEnd = indexOffset;
+		else
+			m_dataEnd = m_fileSize;	// no index, or the program did not close the file
+
+		if (m_header.m_flags & HDATA_FLAG_DELTA)
+			m_codec.setup(m_header);
+	}
+	else if (m_fileSize % HDATA_LEGACY_RECORD_SIZE == 0)
+	{
+		// version 0: raw HapticData structs
+		m_legacy = true;
+		m_header = HdataHeader();
+		m_header.m_version = 0;
+		m_header.m_recordSize = HDATA_LEGACY_RECORD_SIZE;
+		m_header.m_sampleCount = m_fileSize / HDATA_LEGACY_RECORD_SIZE;
+		m_dataEnd = m_fileSize;
+	}
+	else
+	{
+		return fail(fileName + " is not a .hdata file");
+	}
+
+	m_batch.reserve(BATCH_SIZE);
+	rewind();
+	return true;
+}
+
+void HdataReader::close()
+{
+#if defined(_WIN32)
+	if (m_data != 0)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data != 0)
+		munmap((void*)m_data, (size_t)m_fileSize);
+	if (m_file >= 0)
+		::close(m_file);
+	m_file = -1;
+#endif
+
+	m_data = 0;
+	m_fileSize = 0;
+	m_dataEnd = 0;
+	m_pos = m_end = 0;
+	m_index.clear();
+	m_batch.clear();
+}
+
+bool HdataReader::hasTrials() const
+{
+	for (size_t i = 0; i < m_header.m_fields.size(); i++)
+	{
+		if (m_header.m_fields[i].name == "trial")
+			return true;
+	}
+	return false;
+}
+
+void HdataReader::rewind()
+{
+	m_pos = m_legacy ? 0 : m_header.m_headerSize;
+	m_end = m_dataEnd;
+}
+
+bool HdataReader::seekTrial(size_t i)
+{
+	if (i >= m_index.size())
+		return false;
+
+	// the chunks of a trial are contiguous and end where the next trial
+	// starts; the reader only moves to a range that lies within the data
+	unsigned long long pos = m_index[i].offset;
+	unsigned long long end = (i + 1 < m_index.size()) ? m_index[i + 1].offset : m_dataEnd;
+	if (pos < m_header.m_headerSize || pos > end || end > m_dataEnd)
+		return false;
+
+	m_pos = pos;
+	m_end = end;
+	return true;
+}
+
+size_t HdataReader::next(const HdataRecord*& records)
+{
+	m_batch.clear();
+	if (m_data == 0 || m_pos >= m_end)
+		return 0;
+
+	if (m_header.m_flags & HDATA_FLAG_DELTA)
+	{
+		size_t size = m_codec.decodeBlock(m_data + m_pos, (size_t)(m_end - m_pos), m_batch);
+		if (size == 0)
+		{
+			// truncated block at the end of a file that was not closed
+			m_batch.clear();
+			m_pos = m_end;
+			fail("corrupt or truncated delta block");
+			return 0;
+		}
+		m_pos += size;
+	}
+	else
+	{
+		unsigned long long available = (m_end - m_pos) / m_header.m_recordSize;
+		size_t count = available < BATCH_SIZE ? (size_t)available : (size_t)BATCH_SIZE;
+
+		m_batch.resize(count);
+		const unsigned char* in = m_data + m_pos;
+		for (size_t i = 0; i < count; i++, in += m_header.m_recordSize)
+		{
+			if (m_legacy)
+				decodeLegacy(in, m_batch[i]);
+			else
+				m_header.decode(in, m_batch[i]);
+		}
+
+		// a partial record at the end is ignored
+		m_pos = (count > 0) ? m_pos + count * m_header.m_recordSize : m_end;
+	}
+
+	records = m_batch.empty() ? 0 : &m_batch[0];
+	return m_batch.size();
+}
+
+bool HdataReader::fail(const string& error)
+{
+	m_error = error;
+	return false;
+}
+
+// rotation matrix -> unit quaternion (w, x, y, z); chai3d's cMatrix3d is
+// an Eigen Matrix3d, so the nine doubles of a legacy record are column-major
+static void matrixToQuaternion(const double* columns, double* q)
+{
+	// element (row, col) is columns[row + 3 * col]; m is row-major below
+	double m[9];
+	for (int row = 0; row < 3; row++)
+	{
+		for (int col = 0; col < 3; col++)
+			m[3 * row + col] = columns[row + 3 * col];
+	}
+
+	double trace = m[0] + m[4] + m[8];
+
+	if (trace > 0.0)
+	{
+		double s = 0.5 / sqrt(trace + 1.0);
+		q[0] = 0.25 / s;
+		q[1] = (m[7] - m[5]) * s;
+		q[2] = (m[2] - m[6]) * s;
+		q[3] = (m[3] - m[1]) * s;
+	}
+	else if (m[0] > m[4] && m[0] > m[8])
+	{
+		double s = 2.0 * sqrt(1.0 + m[0] - m[4] - m[8]);
+		q[0] = (m[7] - m[5]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (m[1] + m[3]) / s;
+		q[3] = (m[2] + m[6]) / s;
+	}
+	else if (m[4] > m[8])
+	{
+		double s = 2.0 * sqrt(1.0 + m[4] - m[0] - m[8]);
+		q[0] = (m[2] - m[6]) / s;
+		q[1] = (m[1] + m[3]) / s;
+		q[2] = 0.25 * s;
+		q[3] = (m[5] + m[7]) / s;
+	}
+	else
+	{
+		double s = 2.0 * sqrt(1.0 + m[8] - m[0] - m[4]);
+		q[0] = (m[3] - m[1]) / s;
+		q[1] = (m[2] + m[6]) / s;
+		q[2] = (m[5] + m[7]) / s;
+		q[3] = 0.25 * s;
+	}
+}
+
+void HdataReader::decodeLegacy(const unsigned char* in, HdataRecord& record) const
+{
+	// layout of the old HapticData struct: time, refDiceOrientation[9],
+	// actDicePos[3], actDiceOrientation[9], deviceOrientation[9],
+	// devicePos[3], deviceVel[3]
+	double v[37];
+	for (int i = 0; i < 37; i++)
+		v[i] = hdataGetF64(in + 8 * i);
+
+	memset(&record, 0, sizeof(record));
+	record.time = v[0];
+	matrixToQuaternion(v + 1, record.refDiceQuat);
+	for (int i = 0; i < 3; i++)
+	{
+		record.actDicePos[i] = v[10 + i];
+		record.devicePos[i] = v[31 + i];
+		record.deviceVel[i] = v[34 + i];
+	}
+	matrixToQuaternion(v + 13, record.actDiceQuat);
+	matrixToQuaternion(v + 22, record.deviceQuat);
+}
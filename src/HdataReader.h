@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "HdataFormat.h"
+#include "HdataCodec.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+using namespace std;
+
+// Streaming reader for .hdata files (all versions, see HdataFormat.h).
+//
+// The file is memory-mapped read-only and never copied: next() decodes
+// the records straight from the mapping into a small batch owned by the
+// reader (one delta block, or up to BATCH_SIZE fixed-size records), so
+// the memory used does not depend on the size of the file.  Doesn't need
+// chai3d; orientations come out as quaternions even for version 0 files.
+//
+//	HdataReader reader;
+//	reader.open("data.hdata");
+//	const HdataRecord* records;
+//	size_t count;
+//	while ((count = reader.next(records)) > 0)
+//		...
+class HdataReader
+{
+public:
+	enum { BATCH_SIZE = 4096 };
+
+public:
+	HdataReader();
+	~HdataReader();
+
+public:
+	bool open(const string& fileName);	// maps the file and parses header and trial index
+	void close();
+
+	const HdataHeader& getHeader() const { return m_header; }
+	const vector<HdataTrialIndex>& getIndex() const { return m_index; }	// empty if the file has no index
+	bool isLegacy() const { return m_legacy; }	// version 0 file
+	bool hasTrials() const;	// records carry the trial number
+	unsigned long long getFileSize() const { return m_fileSize; }
+	string getError() const { return m_error; }
+
+	void rewind();	// back to the first record of the file
+	bool seekTrial(size_t i);	// restrict the stream to the records of index entry i
+
+	// decodes the next batch; records stays valid until the next call.
+	// Returns the number of records, 0 at the end of the stream or on a
+	// corrupt block (getError() tells which)
+	size_t next(const HdataRecord*& records);
+
+	unsigned long long getPosition() const { return m_pos; }	// byte offset of the next batch
+
+private:
+	bool fail(const string& error);
+	void decodeLegacy(const unsigned char* in, HdataRecord& record) const;
+
+	const unsigned char* m_data;
+	unsigned long long m_fileSize;
+	unsigned long long m_dataEnd;	// end of the records (start of the index)
+	unsigned long long m_pos;
+	unsigned long long m_end;		// end of the current stream
+	bool m_legacy;
+	string m_error;
+
+	HdataHeader m_header;
+	HdataCodec m_codec;
+	vector<HdataTrialIndex> m_index;
+	vector<HdataRecord> m_batch;
+
+#if defined(_WIN32)
+	HANDLE m_file;
+	HANDLE m_mapping;
+#else
+	int m_file;
+#endif
+
+	HdataReader(const HdataReader&);
+	HdataReader& operator=(const HdataReader&);
+};
@@ -0,0 +1,275 @@
+#include "InputTrace.h"
+#include "HdataFormat.h"
+#include "HdataCodec.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace chai3d;
+
+static const char magic[8] = { 'D', 'I', 'C', 'E', 'I', 'T', 'R', 'C' };
+
+
+// frame <-> values in the order of the file
+static void gather(const InputFrame& frame, double* values)
+{
+	*values++ = frame.time;
+	*values++ = frame.trialTime;
+	for (int i = 0; i < 3; i++)
+		*values++ = frame.position(i);
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			*values++ = frame.rotation(i, j);
+	}
+	for (int i = 0; i < 3; i++)
+		*values++ = frame.linearVelocity(i);
+	for (int i = 0; i < 3; i++)
+		*values++ = frame.angularVelocity(i);
+	*values++ = frame.gripperAngle;
+	*values++ = frame.userSwitches;
+	*values++ = frame.flags;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			*values++ = frame.toolRotation(i, j);
+	}
+	for (int i = 0; i < 3; i++)
+		*values++ = frame.refDiceAngles(i);
+}
+
+static void scatter(const double* values, InputFrame& frame)
+{
+	frame.time = *values++;
+	frame.trialTime = *values++;
+	for (int i = 0; i < 3; i++)
+		frame.position(i) = *values++;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			frame.rotation(i, j) = *values++;
+	}
+	for (int i = 0; i < 3; i++)
+		frame.linearVelocity(i) = *values++;
+	for (int i = 0; i < 3; i++)
+		frame.angularVelocity(i) = *values++;
+	frame.gripperAngle = *values++;
+	frame.userSwitches = (unsigned int)*values++;
+	frame.flags = (unsigned int)*values++;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			frame.toolRotation(i, j) = *values++;
+	}
+	for (int i = 0; i < 3; i++)
+		frame.refDiceAngles(i) = *values++;
+}
+
+static inline unsigned long long toBits(double v)
+{
+	unsigned long long bits;
+	memcpy(&bits, &v, 8);
+	return bits;
+}
+
+static inline double fromBits(unsigned long long bits)
+{
+	double v;
+	memcpy(&v, &bits, 8);
+	return v;
+}
+
+
+InputTraceWriter::InputTraceWriter()
+{
+	m_writer = 0;
+	m_frames = 0;
+	m_stopRequested = false;
+	m_finished = false;
+}
+
+InputTraceWriter::~InputTraceWriter()
+{
+	close();
+}
+
+bool InputTraceWriter::open(const string& fileName, const InputTraceDevice& device)
+{
+	m_writer = LogWriter::create("STDIO");
+	if (!m_writer->open(fileName))
+	{
+		cerr << "Error: Input trace " << fileName << " could not be opened!" << endl;
+		delete m_writer;
+		m_writer = 0;
+		return false;
+	}
+
+	unsigned char header[INPUT_TRACE_HEADER_SIZE];
+	memcpy(header, magic, 8);
+	hdataPutU16(header + 8, INPUT_TRACE_VERSION);
+	hdataPutU16(header + 10, 0);
+	hdataPutU32(header + 12, INPUT_TRACE_VALUES);
+	hdataPutF64(header + 16, device.workspaceRadius);
+	hdataPutF64(header + 24, device.maxLinearForce);
+	hdataPutF64(header + 32, device.maxLinearStiffness);
+	hdataPutF64(header + 40, device.maxLinearDamping);
+
+	return m_writer->write(header, sizeof(header));
+}
+
+void InputTraceWriter::close()
+{
+	if (m_writer != 0)
+	{
+		m_writer->close();
+		delete m_writer;
+		m_writer = 0;
+	}
+}
+
+bool InputTraceWriter::push(const InputFrame& frame)
+{
+	return m_ring.try_push(frame);
+}
+
+void InputTraceWriter::run()
+{
+	// the ring holds seconds of frames, so polling is good enough here;
+	// a fast loop (simulated or replayed device) is kept up with by not
+	// sleeping while whole blocks are waiting
+	while (!m_stopRequested)
+	{
+		if (m_ring.size() < BLOCK_SIZE)
+			this_thread::sleep_for(chrono::milliseconds(20));
+		writeBlocks(false);
+	}
+
+	writeBlocks(true);
+	m_finished = true;
+}
+
+void InputTraceWriter::stop()
+{
+	m_stopRequested = true;
+}
+
+void InputTraceWriter::writeBlocks(bool all)
+{
+	if (m_writer == 0)
+		return;
+
+	double values[INPUT_TRACE_VALUES];
+	m_previous.resize(INPUT_TRACE_VALUES);
+
+	// full blocks while running, the rest once stopped
+	while (m_ring.size() >= BLOCK_SIZE || (all && m_ring.size() > 0))
+	{
+		size_t count = m_ring.size() < BLOCK_SIZE ? m_ring.size() : (size_t)BLOCK_SIZE;
+		unsigned char* out = m_writer->reserve(HDATA_BLOCK_HEADER_SIZE + count * INPUT_TRACE_VALUES * 10);
+		unsigned char* p = out + HDATA_BLOCK_HEADER_SIZE;
+
+		fill(m_previous.begin(), m_previous.end(), 0);
+
+		for (size_t done = 0; done < count;)
+		{
+			InputFrame* frames;
+			size_t n = m_ring.peek(frames);
+			if (n > count - done)
+				n = count - done;
+
+			for (size_t f = 0; f < n; f++)
+			{
+				gather(frames[f], values);
+				for (int i = 0; i < INPUT_TRACE_VALUES; i++)
+				{
+					unsigned long long bits = toBits(values[i]);
+					p = hdataPutVarint(p, (long long)(bits - m_previous[i]));
+					m_previous[i] = bits;
+				}
+			}
+
+			m_ring.pop(n);
+			done += n;
+		}
+
+		hdataPutU32(out, (unsigned int)count);
+		hdataPutU32(out + 4, (unsigned int)(p - out - HDATA_BLOCK_HEADER_SIZE));
+		if (!m_writer->commit(p - out))
+		{
+			cerr << "Error: Input trace could not be written!" << endl;
+			return;
+		}
+		m_frames += count;
+	}
+}
+
+
+InputTraceReader::InputTraceReader()
+{
+	memset(&m_device, 0, sizeof(m_device));
+}
+
+bool InputTraceReader::open(const string& fileName)
+{
+	m_frames.clear();
+
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == 0)
+		return false;
+
+	vector<unsigned char> data;
+	unsigned char buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + n);
+	fclose(file);
+
+	if (data.size() < INPUT_TRACE_HEADER_SIZE || memcmp(&data[0], magic, 8) != 0 ||
+		hdataGetU16(&data[8]) != INPUT_TRACE_VERSION || hdataGetU32(&data[12]) != INPUT_TRACE_VALUES)
+		return false;
+
+	m_device.workspaceRadius = hdataGetF64(&data[16]);
+	m_device.maxLinearForce = hdataGetF64(&data[24]);
+	m_device.maxLinearStiffness = hdataGetF64(&data[32]);
+	m_device.maxLinearDamping = hdataGetF64(&data[40]);
+
+	double values[INPUT_TRACE_VALUES];
+	unsigned long long previous[INPUT_TRACE_VALUES];
+
+	size_t pos = INPUT_TRACE_HEADER_SIZE;
+	while (pos + HDATA_BLOCK_HEADER_SIZE <= data.size())
+	{
+		size_t count = hdataGetU32(&data[pos]);
+		size_t payload = hdataGetU32(&data[pos + 4]);
+		if (payload > data.size() - pos - HDATA_BLOCK_HEADER_SIZE)
+			return false;
+
+		const unsigned char* p = &data[pos + HDATA_BLOCK_HEADER_SIZE];
+		const unsigned char* end = p + payload;
+
+		memset(previous, 0, sizeof(previous));
+		for (size_t f = 0; f < count; f++)
+		{
+			for (int i = 0; i < INPUT_TRACE_VALUES; i++)
+			{
+				long long delta;
+				p = hdataGetVarint(p, end, delta);
+				if (p == 0)
+					return false;
+
+				previous[i] += (unsigned long long)delta;
+				values[i] = fromBits(previous[i]);
+			}
+
+			InputFrame frame;
+			scatter(values, frame);
+			m_frames.push_back(frame);
+		}
+
+		pos += HDATA_BLOCK_HEADER_SIZE + payload;
+	}
+
+	return true;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "chai3d.h"
+#include "LogWriter.h"
+#include "spsc_ring.h"
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+// Binary format of the .itrace input traces (see TraceDevice.h)
+//
+// All values are little-endian.  A trace starts with a header:
+//
+//   offset  size  content
+//   0       8     magic "DICEITRC"
+//   8       2     format version (INPUT_TRACE_VERSION)
+//   10      2     reserved
+//   12      4     number of values per frame (INPUT_TRACE_VALUES)
+//   16      8     workspace radius of the device [m] (f64)
+//   24      8     maximum linear force [N] (f64)
+//   32      8     maximum linear stiffness [N/m] (f64)
+//   40      8     maximum linear damping [N/(m/s)] (f64)
+//
+// followed by blocks of frames, coded like the delta blocks of the .hdata
+// files with a quantization step of 0 (see HdataCodec.h): u32 number of
+// frames, u32 payload size, then per frame and value the zigzag varint
+// of the difference of the raw f64 bits to the previous frame.  The
+// coding is lossless, so a replayed session sees bit for bit the values
+// of the recorded one.
+//
+// The values of a frame are the InputFrame members in declaration order,
+// matrices row by row.
+//------------------------------------------------------------------------------
+
+#define INPUT_TRACE_VERSION 2
+#define INPUT_TRACE_VALUES 35
+#define INPUT_TRACE_HEADER_SIZE 48
+
+// frame flags
+#define INPUT_TRACE_TRIAL_START 0x0001	// the next trial started on this tick
+#define INPUT_TRACE_TOOL_ROTATION 0x0002	// the tool was lined up with the camera (toolRotation)
+#define INPUT_TRACE_REF_DICE_TURN 0x0004	// the reference dice was turned (refDiceAngles)
+#define INPUT_TRACE_RESET 0x0008		// the world was reset from the menu
+#define INPUT_TRACE_MATCH 0x0010		// a match with the reference completed the trial (see OrientationMatch.h)
+
+// Everything the haptic loop reads from outside in one tick
+struct InputFrame
+{
+	double time;					// [s] since the start of the recording
+	double trialTime;				// reading of the trial timer [s]
+	chai3d::cVector3d position;
+	chai3d::cMatrix3d rotation;
+	chai3d::cVector3d linearVelocity;
+	chai3d::cVector3d angularVelocity;
+	double gripperAngle;			// [rad]
+	unsigned int userSwitches;
+	unsigned int flags;				// INPUT_TRACE_* bits
+	chai3d::cMatrix3d toolRotation;	// with INPUT_TRACE_TOOL_ROTATION
+	chai3d::cVector3d refDiceAngles;	// extrinsic Euler angles [deg], with INPUT_TRACE_REF_DICE_TURN
+};
+
+// Specifications of the recorded device that shape the scene
+struct InputTraceDevice
+{
+	double workspaceRadius;
+	double maxLinearForce;
+	double maxLinearStiffness;
+	double maxLinearDamping;
+};
+
+// Writes a trace.  The haptic thread calls push(), which only copies the
+// frame into a lock-free ring; the trace thread runs run(), which codes
+// and writes the frames in blocks, like the flushing thread of DataLogger.
+class InputTraceWriter
+{
+public:
+	enum { BLOCK_SIZE = 1024, RING_SIZE = 16384 };
+
+public:
+	InputTraceWriter();
+	~InputTraceWriter();
+
+public:
+	bool open(const string& fileName, const InputTraceDevice& device);
+	void close();	// after run() has returned
+
+	bool push(const InputFrame& frame);	// haptic thread: never blocks
+
+	void run();				// trace thread: write blocks until stop() is called
+	void stop();
+	bool isFinished() { return m_finished; }
+
+	unsigned long long getFrames() const { return m_frames; }
+	size_t getDroppedFrames() { return m_ring.dropped(); }
+
+private:
+	void writeBlocks(bool all);
+
+private:
+	LogWriter* m_writer;
+	spsc_ring<InputFrame, RING_SIZE> m_ring;
+	vector<unsigned long long> m_previous;
+	unsigned long long m_frames;
+
+	atomic<bool> m_stopRequested;
+	atomic<bool> m_finished;
+};
+
+// Reads a whole trace into memory for replay.
+class InputTraceReader
+{
+public:
+	InputTraceReader();
+
+public:
+	bool open(const string& fileName);	// false if the file is missing, truncated or not a trace
+
+	const InputTraceDevice& getDevice() const { return m_device; }
+	size_t getNumFrames() const { return m_frames.size(); }
+	const InputFrame& getFrame(size_t i) const { return m_frames[i]; }
+
+private:
+	InputTraceDevice m_device;
+	vector<InputFrame> m_frames;
+};
@@ -0,0 +1,132 @@
+#include "LatencyHistogram.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#endif
+
+
+unsigned long long latencyNow()
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// split to avoid overflowing 64 bits for long uptimes
+	unsigned long long seconds = counter.QuadPart / frequency.QuadPart;
+	unsigned long long rest = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000ULL + rest * 1000000000ULL / frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+// index of the highest set bit (value > 0)
+static inline int highestBit(unsigned long long value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+		return (int)index + 32;
+	_BitScanReverse(&index, (unsigned long)value);
+	return (int)index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+void LatencyHistogram::reset()
+{
+	for (int i = 0; i < NUM_BUCKETS; i++)
+		m_buckets[i].store(0, memory_order_relaxed);
+	m_count.store(0, memory_order_relaxed);
+	m_sum.store(0, memory_order_relaxed);
+	m_max.store(0, memory_order_relaxed);
+}
+
+int LatencyHistogram::getIndex(unsigned long long ns)
+{
+	if (ns < SUB_BUCKETS)
+		return (int)ns;
+
+	// shift the value into [SUB_BUCKETS / 2, SUB_BUCKETS); each shift step
+	// adds another SUB_BUCKETS / 2 buckets
+	int shift = highestBit(ns) - (SUB_BUCKET_BITS - 1);
+	return shift * (SUB_BUCKETS / 2) + (int)(ns >> shift);
+}
+
+unsigned long long LatencyHistogram::getUpperBound(int index)
+{
+	if (index < SUB_BUCKETS)
+		return index;
+
+	int shift = index / (SUB_BUCKETS / 2) - 1;
+	unsigned long long sub = index - shift * (SUB_BUCKETS / 2);
+	return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(unsigned long long ns)
+{
+	if (ns > MAX_VALUE)
+		ns = MAX_VALUE;
+
+	// single writer: plain load + store, no locked instructions
+	atomic<unsigned long long>& bucket = m_buckets[getIndex(ns)];
+	bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	m_sum.store(m_sum.load(memory_order_relaxed) + ns, memory_order_relaxed);
+	if (ns > m_max.load(memory_order_relaxed))
+		m_max.store(ns, memory_order_relaxed);
+	m_count.store(m_count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+double LatencyHistogram::getMean() const
+{
+	unsigned long long count = getCount();
+	return count > 0 ? (double)m_sum.load(memory_order_relaxed) / count : 0.0;
+}
+
+unsigned long long LatencyHistogram::getPercentile(double percentile) const
+{
+	unsigned long long count = getCount();
+	if (count == 0)
+		return 0;
+
+	// rank of the requested value, counted from 1
+	unsigned long long rank = (unsigned long long)(percentile / 100.0 * count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > count)
+		rank = count;
+
+	unsigned long long seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; i++)
+	{
+		seen += m_buckets[i].load(memory_order_relaxed);
+		if (seen >= rank)
+		{
+			// never report more than the largest value actually seen
+			unsigned long long bound = getUpperBound(i);
+			unsigned long long max = getMax();
+			return bound < max ? bound : max;
+		}
+	}
+	return getMax();
+}
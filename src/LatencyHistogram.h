@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+
+using namespace std;
+
+// Current time of a monotonic high-resolution clock [ns].  Uses
+// QueryPerformanceCounter on Windows (std::chrono::steady_clock of VS2013
+// only ticks every millisecond) and CLOCK_MONOTONIC elsewhere.
+unsigned long long latencyNow();
+
+// HDR (high dynamic range) histogram of durations in nanoseconds.
+//
+// Values are counted in log-linear buckets: values below SUB_BUCKETS
+// have a bucket each, above that every power of two is split into
+// SUB_BUCKETS / 2 buckets, so any value is known to within 1/64 (1.6%)
+// from 1 ns up to MAX_VALUE (about 68 s; larger values are clamped).
+// The whole histogram is a fixed array of counters, so record() is a
+// few instructions and never allocates.
+//
+// record() must only be called from a single thread (the haptic thread);
+// it updates the counters with relaxed atomic stores instead of
+// read-modify-write instructions.  The other methods may be called from
+// any thread at any time and then see a slightly torn but usable state.
+class LatencyHistogram
+{
+public:
+	enum
+	{
+		SUB_BUCKET_BITS = 7,
+		SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+		MAX_BITS = 36,
+		NUM_BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 2) * (SUB_BUCKETS / 2)
+	};
+
+	static const unsigned long long MAX_VALUE = (1ULL << MAX_BITS) - 1;
+
+public:
+	LatencyHistogram();
+
+public:
+	void record(unsigned long long ns);
+	void reset();	// only when the writing thread is not running
+
+	unsigned long long getCount() const { return m_count.load(memory_order_relaxed); }
+	unsigned long long getMax() const { return m_max.load(memory_order_relaxed); }
+	double getMean() const;
+	unsigned long long getPercentile(double percentile) const;	// e.g. 99.9; upper bound of the bucket [ns]
+
+private:
+	static int getIndex(unsigned long long ns);
+	static unsigned long long getUpperBound(int index);
+
+	atomic<unsigned long long> m_buckets[NUM_BUCKETS];
+	atomic<unsigned long long> m_count;
+	atomic<unsigned long long> m_sum;
+	atomic<unsigned long long> m_max;
+
+	LatencyHistogram(const LatencyHistogram&);
+	LatencyHistogram& operator=(const LatencyHistogram&);
+};
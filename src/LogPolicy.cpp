@@ -0,0 +1,103 @@
+#include "LogPolicy.h"
+#include <cmath>
+
+using namespace chai3d;
+
+
+LogPolicy::LogPolicy()
+{
+	m_adaptive = false;
+	m_idleRate = 50.0;
+	m_positionThreshold = 1e-4;
+	m_angleThreshold = 0.1 * 0.017453292519943;
+
+	m_first = true;
+	m_lastSelection = false;
+	m_lastContact = false;
+
+	m_ticks = 0;
+	m_logged = 0;
+	m_fullRate = 0;
+	m_idle = 0;
+	m_changed = 0;
+}
+
+unsigned int LogPolicy::select(const HapticData& sample, bool selection, bool contact)
+{
+	unsigned int flags = 0;
+	m_ticks++;
+
+	if (selection)
+		flags |= HDATA_SAMPLE_SELECTION;
+	if (contact)
+		flags |= HDATA_SAMPLE_CONTACT;
+
+	if (!m_adaptive)
+	{
+		flags |= HDATA_SAMPLE_ALL;
+	}
+	else if (m_first || selection != m_lastSelection || contact != m_lastContact ||
+		sample.trial != m_lastLogged.trial || sample.time < m_lastLogged.time)
+	{
+		// the timer is reset between trials, hence the check for time going back
+		flags |= HDATA_SAMPLE_TRANSITION;
+	}
+	else if (!selection && !contact)
+	{
+		if (m_idleRate > 0.0 && sample.time - m_lastLogged.time >= 1.0 / m_idleRate)
+			flags |= HDATA_SAMPLE_IDLE;
+		if (hasMoved(sample))
+			flags |= HDATA_SAMPLE_CHANGE;
+	}
+
+	m_first = false;
+	m_lastSelection = selection;
+	m_lastContact = contact;
+
+	if (flags == 0)
+		return 0;
+
+	m_logged++;
+	if (flags & (HDATA_SAMPLE_SELECTION | HDATA_SAMPLE_CONTACT | HDATA_SAMPLE_TRANSITION | HDATA_SAMPLE_ALL))
+		m_fullRate++;
+	else if (flags & HDATA_SAMPLE_CHANGE)
+		m_changed++;
+	else
+		m_idle++;
+
+	m_lastLogged = sample;
+	return flags;
+}
+
+// angle between two rotations is below the threshold if cos(angle) = (trace(A^T B) - 1) / 2 is above cos(threshold)
+static double cosAngleBetween(const cMatrix3d& a, const cMatrix3d& b)
+{
+	double trace = 0.0;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			trace += a(i, j) * b(i, j);
+	}
+	return 0.5 * (trace - 1.0);
+}
+
+bool LogPolicy::hasMoved(const HapticData& sample) const
+{
+	if (sample.actDicePos.distance(m_lastLogged.actDicePos) > m_positionThreshold ||
+		sample.devicePos.distance(m_lastLogged.devicePos) > m_positionThreshold)
+		return true;
+
+	double cosThreshold = cos(m_angleThreshold);
+	return cosAngleBetween(sample.actDiceOrientation, m_lastLogged.actDiceOrientation) < cosThreshold ||
+		cosAngleBetween(sample.deviceOrientation, m_lastLogged.deviceOrientation) < cosThreshold;
+}
+
+void LogPolicy::printStatistics()
+{
+	if (!m_adaptive || m_ticks == 0)
+		return;
+
+	cout << "Log policy: " << m_logged << " of " << m_ticks << " ticks logged ("
+		<< 100.0 * m_logged / m_ticks << "%), " << m_fullRate << " at full rate, "
+		<< m_idle << " idle, " << m_changed << " on change" << endl;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <iostream>
+#include "HapticData.h"
+#include "HdataFormat.h"
+
+using namespace std;
+
+// Decides which haptic ticks are worth logging.
+//
+// With m_adaptive off every tick is logged, as before.  With it on, ticks
+// in which the dice is manipulated (SELECTION) or the tool touches the
+// virtual button are still logged at full rate, as is the first tick
+// after any change of state or trial.  Idle ticks are logged at
+// m_idleRate, plus whenever the dice or the device has moved or turned
+// more than the thresholds since the last logged sample.  Everything
+// else is dropped before it reaches the logger.
+//
+// select() returns the HDATA_SAMPLE_* bits that describe why the sample
+// is logged (stored in HapticData::flags), or 0 to drop it.  Called from
+// the haptic thread only.
+class LogPolicy
+{
+public:
+	bool m_adaptive;				// false: log every tick
+	double m_idleRate;				// rate [Hz] of the periodic idle samples (0: only changes)
+	double m_positionThreshold;		// idle movement [m] of the dice or device that is logged
+	double m_angleThreshold;		// idle rotation [rad] of the dice or device that is logged
+
+public:
+	LogPolicy();
+
+public:
+	unsigned int select(const HapticData& sample, bool selection, bool contact);
+
+	void printStatistics();	// after the haptic thread has finished
+
+private:
+	bool hasMoved(const HapticData& sample) const;
+
+	bool m_first;
+	bool m_lastSelection;
+	bool m_lastContact;
+	HapticData m_lastLogged;
+
+	unsigned long long m_ticks;
+	unsigned long long m_logged;
+	unsigned long long m_fullRate;	// selection, contact and transition samples
+	unsigned long long m_idle;
+	unsigned long long m_changed;
+};
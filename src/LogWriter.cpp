@@ -0,0 +1,318 @@
+#include "LogWriter.h"
+#include "AsyncWriter.h"
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+
+bool LogWriter::write(const unsigned char* data, size_t size)
+{
+	unsigned char* p = reserve(size);
+	if (p == 0)
+		return false;
+
+	memcpy(p, data, size);
+	return commit(size);
+}
+
+LogWriter* LogWriter::create(const string& backend)
+{
+	if (backend == "STDIO")
+		return new StdioWriter();
+	if (backend == "MMAP")
+		return new MappedWriter();
+	if (backend == "ASYNC")
+		return new AsyncWriter(false);
+	if (backend == "DIRECT")
+		return new AsyncWriter(true);
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+
+StdioWriter::StdioWriter()
+{
+	m_file = 0;
+	m_size = 0;
+}
+
+StdioWriter::~StdioWriter()
+{
+	close();
+}
+
+bool StdioWriter::open(const string& fileName)
+{
+	m_file = fopen(fileName.c_str(), "wb");
+	m_size = 0;
+	return m_file != 0;
+}
+
+void StdioWriter::close()
+{
+	if (m_file != 0)
+	{
+		fclose(m_file);
+		m_file = 0;
+	}
+}
+
+unsigned char* StdioWriter::reserve(size_t maxSize)
+{
+	if (m_buffer.size() < maxSize)
+		m_buffer.resize(maxSize);
+	return &m_buffer[0];
+}
+
+bool StdioWriter::commit(size_t size)
+{
+	size_t written = fwrite(&m_buffer[0], 1, size, m_file);
+	m_size += written;
+	return written == size;
+}
+
+bool StdioWriter::writeAt(unsigned long long offset, const unsigned char* data, size_t size)
+{
+	if (offset + size > m_size || fseek(m_file, (long)offset, SEEK_SET) != 0)
+		return false;
+
+	bool ok = fwrite(data, 1, size, m_file) == size;
+	fseek(m_file, 0, SEEK_END);
+	return ok;
+}
+
+void StdioWriter::sync()
+{
+	fflush(m_file);
+}
+
+//------------------------------------------------------------------------------
+
+MappedWriter::MappedWriter()
+{
+#if defined(_WIN32)
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	m_file = -1;
+#endif
+	m_size = 0;
+	m_synced = 0;
+	m_bounced = false;
+}
+
+MappedWriter::~MappedWriter()
+{
+	close();
+}
+
+bool MappedWriter::open(const string& fileName)
+{
+#if defined(_WIN32)
+	m_file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	m_file = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_file < 0)
+		return false;
+#endif
+
+	m_size = 0;
+	m_synced = 0;
+	m_extents.clear();
+
+	return addExtent();
+}
+
+void MappedWriter::close()
+{
+#if defined(_WIN32)
+	if (m_file == INVALID_HANDLE_VALUE)
+		return;
+#else
+	if (m_file < 0)
+		return;
+#endif
+
+	// nothing is mapped if the first extent could not be added
+	if (!m_extents.empty())
+		sync();
+
+	for (size_t i = 0; i < m_extents.size(); i++)
+	{
+		if (m_extents[i].data == 0)
+			continue;
+#if defined(_WIN32)
+		UnmapViewOfFile(m_extents[i].data);
+		CloseHandle(m_extents[i].mapping);
+#else
+		munmap(m_extents[i].data, EXTENT_SIZE);
+#endif
+	}
+	m_extents.clear();
+
+	// drop the preallocated space that was never used
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	size.QuadPart = m_size;
+	SetFilePointerEx(m_file, size, NULL, FILE_BEGIN);
+	SetEndOfFile(m_file);
+	CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (ftruncate(m_file, m_size) != 0)
+		perror("MappedWriter: ftruncate");
+	::close(m_file);
+	m_file = -1;
+#endif
+}
+
+unsigned char* MappedWriter::reserve(size_t maxSize)
+{
+	size_t extent = (size_t)(m_size / EXTENT_SIZE);
+	size_t offset = (size_t)(m_size % EXTENT_SIZE);
+
+	while (m_extents.size() <= extent)
+	{
+		if (!addExtent())
+			return 0;
+	}
+
+	// encode directly into the mapping whenever the data fits in the current extent
+	m_bounced = (offset + maxSize > EXTENT_SIZE);
+	if (!m_bounced)
+		return m_extents[extent].data + offset;
+
+	if (m_bounce.size() < maxSize)
+		m_bounce.resize(maxSize);
+	return &m_bounce[0];
+}
+
+bool MappedWriter::commit(size_t size)
+{
+	if (m_bounced)
+	{
+		while (m_extents.size() * (unsigned long long)EXTENT_SIZE < m_size + size)
+		{
+			if (!addExtent())
+				return false;
+		}
+		copyOut(m_size, &m_bounce[0], size);
+	}
+
+	m_size += size;
+	return true;
+}
+
+bool MappedWriter::writeAt(unsigned long long offset, const unsigned char* data, size_t size)
+{
+	if (offset + size > m_size)
+		return false;
+
+	// only regions that are still mapped (the first and the current extents) can be rewritten
+	for (unsigned long long i = offset / EXTENT_SIZE; i <= (offset + size - 1) / EXTENT_SIZE; i++)
+	{
+		if (m_extents[(size_t)i].data == 0)
+			return false;
+	}
+
+	copyOut(offset, data, size);
+	return true;
+}
+
+void MappedWriter::sync()
+{
+	const unsigned long long page = 4096;
+
+	while (m_synced < m_size)
+	{
+		size_t extent = (size_t)(m_synced / EXTENT_SIZE);
+		unsigned long long start = m_synced / page * page;
+		unsigned long long end = (extent + 1) * (unsigned long long)EXTENT_SIZE;
+		if (end > m_size) end = m_size;
+
+		unsigned char* base = m_extents[extent].data;
+		size_t from = (size_t)(start - extent * (unsigned long long)EXTENT_SIZE);
+		size_t length = (size_t)(end - start);
+
+#if defined(_WIN32)
+		FlushViewOfFile(base + from, length);
+#else
+		msync(base + from, length, MS_ASYNC);
+#endif
+		m_synced = end;
+
+		// an extent that is complete and synced is not needed any more (the
+		// first one stays mapped so that the header can still be patched)
+		if (end == (extent + 1) * (unsigned long long)EXTENT_SIZE && extent > 0)
+		{
+#if defined(_WIN32)
+			UnmapViewOfFile(base);
+			CloseHandle(m_extents[extent].mapping);
+#else
+			munmap(base, EXTENT_SIZE);
+#endif
+			m_extents[extent].data = 0;
+		}
+	}
+}
+
+bool MappedWriter::addExtent()
+{
+	unsigned long long offset = m_extents.size() * (unsigned long long)EXTENT_SIZE;
+	Extent extent;
+
+#if defined(_WIN32)
+	LARGE_INTEGER end, start;
+	end.QuadPart = offset + EXTENT_SIZE;
+	start.QuadPart = offset;
+
+	// preallocate the extent, then map it
+	if (!SetFilePointerEx(m_file, end, NULL, FILE_BEGIN) || !SetEndOfFile(m_file))
+		return false;
+
+	extent.mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, end.HighPart, end.LowPart, NULL);
+	if (extent.mapping == NULL)
+		return false;
+
+	extent.data = (unsigned char*)MapViewOfFile(extent.mapping, FILE_MAP_WRITE, start.HighPart, start.LowPart, EXTENT_SIZE);
+	if (extent.data == NULL)
+	{
+		CloseHandle(extent.mapping);
+		return false;
+	}
+#else
+	// preallocate the extent (falls back to a sparse extension if the file system can't)
+	if (posix_fallocate(m_file, (off_t)offset, EXTENT_SIZE) != 0 && ftruncate(m_file, (off_t)(offset + EXTENT_SIZE)) != 0)
+		return false;
+
+	void* p = mmap(0, EXTENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, (off_t)offset);
+	if (p == MAP_FAILED)
+		return false;
+	extent.data = (unsigned char*)p;
+#endif
+
+	m_extents.push_back(extent);
+	return true;
+}
+
+void MappedWriter::copyOut(unsigned long long offset, const unsigned char* data, size_t size)
+{
+	while (size > 0)
+	{
+		size_t extent = (size_t)(offset / EXTENT_SIZE);
+		size_t from = (size_t)(offset % EXTENT_SIZE);
+		size_t length = EXTENT_SIZE - from;
+		if (length > size) length = size;
+
+		memcpy(m_extents[extent].data + from, data, length);
+
+		offset += length;
+		data += length;
+		size -= length;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+using namespace std;
+
+// Sink for the bytes of a log file, used by the flushing thread.
+//
+// Data is appended with reserve()/commit(): reserve() returns space for
+// up to maxSize bytes, the caller encodes straight into it and commit()
+// appends the bytes actually used.  Depending on the backend the space
+// is an internal buffer or the file mapping itself.
+class LogWriter
+{
+public:
+	virtual ~LogWriter() {}
+
+public:
+	virtual bool open(const string& fileName) = 0;
+	virtual void close() = 0;	// writes everything and truncates the file to its real size
+
+	virtual unsigned char* reserve(size_t maxSize) = 0;
+	virtual bool commit(size_t size) = 0;
+
+	bool write(const unsigned char* data, size_t size);	// append a copy of data
+	virtual bool writeAt(unsigned long long offset, const unsigned char* data, size_t size) = 0;	// overwrite bytes already written
+
+	virtual void sync() = 0;	// start writing the committed data to disk without waiting for it
+
+	unsigned long long getSize() { return m_size; }
+
+	virtual string getStatistics() { return ""; }	// backend specific counters, for the console
+
+	// "STDIO", "MMAP", "ASYNC" or "DIRECT" (asynchronous with O_DIRECT); returns 0 for an unknown backend
+	static LogWriter* create(const string& backend);
+
+protected:
+	unsigned long long m_size;	// bytes committed so far
+};
+
+// fopen/fwrite/fflush backend
+class StdioWriter : public LogWriter
+{
+public:
+	StdioWriter();
+	~StdioWriter();
+
+public:
+	bool open(const string& fileName);
+	void close();
+	unsigned char* reserve(size_t maxSize);
+	bool commit(size_t size);
+	bool writeAt(unsigned long long offset, const unsigned char* data, size_t size);
+	void sync();
+
+private:
+	FILE* m_file;
+	vector<unsigned char> m_buffer;
+};
+
+// Memory-mapped backend.  The file is preallocated and mapped in large
+// extents, and blocks are encoded directly into the mapping; sync() asks
+// the OS to write the dirty pages back asynchronously.  close() unmaps
+// the extents and truncates the file to the committed size.
+class MappedWriter : public LogWriter
+{
+public:
+	enum { EXTENT_SIZE = 64 * 1024 * 1024 };
+
+public:
+	MappedWriter();
+	~MappedWriter();
+
+public:
+	bool open(const string& fileName);
+	void close();
+	unsigned char* reserve(size_t maxSize);
+	bool commit(size_t size);
+	bool writeAt(unsigned long long offset, const unsigned char* data, size_t size);
+	void sync();
+
+private:
+	struct Extent
+	{
+		unsigned char* data;
+#if defined(_WIN32)
+		HANDLE mapping;
+#endif
+	};
+
+	bool addExtent();
+	void copyOut(unsigned long long offset, const unsigned char* data, size_t size);
+
+private:
+#if defined(_WIN32)
+	HANDLE m_file;
+#else
+	int m_file;
+#endif
+	vector<Extent> m_extents;
+	unsigned long long m_synced;	// bytes already handed to sync()
+	vector<unsigned char> m_bounce;	// used when a reservation straddles two extents
+	bool m_bounced;
+};
@@ -0,0 +1,139 @@
+#include "OrientationMatch.h"
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ORIENTATION_MATCH_SSE2
+#endif
+
+using namespace chai3d;
+
+// The 24 rotations of the cube, one column each, the identity first: row
+// e holds entry (e / 3, e % 3) of every rotation, so that one load picks
+// the same entry of two rotations
+enum { NUM_ROTATIONS = 24 };
+
+static const double cubeRotations[9][NUM_ROTATIONS] =
+{
+	{  1,  1, -1, -1,  1,  1, -1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	// m00
+	{  0,  0,  0,  0,  0,  0,  0,  0,  1,  1, -1, -1,  1,  1, -1, -1,  0,  0,  0,  0,  0,  0,  0,  0 },	// m01
+	{  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1, -1, -1,  1,  1, -1, -1 },	// m02
+	{  0,  0,  0,  0,  0,  0,  0,  0,  1, -1,  1, -1,  0,  0,  0,  0,  1, -1,  1, -1,  0,  0,  0,  0 },	// m10
+	{  1, -1,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1, -1,  1, -1 },	// m11
+	{  0,  0,  0,  0,  1, -1,  1, -1,  0,  0,  0,  0,  1, -1,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0 },	// m12
+	{  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1, -1, -1,  1,  0,  0,  0,  0, -1,  1,  1, -1 },	// m20
+	{  0,  0,  0,  0, -1,  1,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  1, -1, -1,  1,  0,  0,  0,  0 },	// m21
+	{  1, -1, -1,  1,  0,  0,  0,  0, -1,  1,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	// m22
+};
+
+
+OrientationMatch::OrientationMatch()
+{
+	m_shape = false;
+	m_threshold = 0.0;
+	m_holdTime = 0.5;
+
+	m_armed = false;
+	m_matching = false;
+	m_matchedSince = 0.0;
+	m_completions = 0;
+}
+
+double OrientationMatch::angle(const cMatrix3d& actual, const cMatrix3d& reference) const
+{
+	// D = R_ref^T * R_act, row by row
+	double d[9];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			d[3 * i + j] = reference(0, i) * actual(0, j) + reference(1, i) * actual(1, j) + reference(2, i) * actual(2, j);
+	}
+
+	// trace(D * S^T) for every rotation S (the group holds S^T as well), keep the largest
+	double trace;
+	if (!m_shape)
+	{
+		trace = d[0] + d[4] + d[8];
+	}
+	else
+	{
+#ifdef ORIENTATION_MATCH_SSE2
+		__m128d sum[NUM_ROTATIONS / 2];
+		for (int k = 0; k < NUM_ROTATIONS / 2; k++)
+			sum[k] = _mm_setzero_pd();
+
+		for (int e = 0; e < 9; e++)
+		{
+			__m128d de = _mm_set1_pd(d[e]);
+			for (int k = 0; k < NUM_ROTATIONS / 2; k++)
+				sum[k] = _mm_add_pd(sum[k], _mm_mul_pd(de, _mm_loadu_pd(&cubeRotations[e][2 * k])));
+		}
+
+		__m128d best = sum[0];
+		for (int k = 1; k < NUM_ROTATIONS / 2; k++)
+			best = _mm_max_pd(best, sum[k]);
+		best = _mm_max_sd(best, _mm_unpackhi_pd(best, best));
+		trace = _mm_cvtsd_f64(best);
+#else
+		double sum[NUM_ROTATIONS] = {};
+		for (int e = 0; e < 9; e++)
+		{
+			for (int k = 0; k < NUM_ROTATIONS; k++)
+				sum[k] += d[e] * cubeRotations[e][k];
+		}
+
+		trace = sum[0];
+		for (int k = 1; k < NUM_ROTATIONS; k++)
+			trace = (sum[k] > trace) ? sum[k] : trace;
+#endif
+	}
+
+	// cos(angle) = (trace - 1) / 2, clamped against rounding
+	double c = 0.5 * (trace - 1.0);
+	if (c > 1.0)
+		c = 1.0;
+	else if (c < -1.0)
+		c = -1.0;
+	return acos(c);
+}
+
+bool OrientationMatch::update(double angle, bool released, double time)
+{
+	if (!released)
+		m_armed = true;
+
+	if (m_threshold <= 0.0 || !m_armed || !released || angle > m_threshold)
+	{
+		m_matching = false;
+		return false;
+	}
+
+	if (!m_matching)
+	{
+		m_matching = true;
+		m_matchedSince = time;
+	}
+	if (time - m_matchedSince < m_holdTime)
+		return false;
+
+	m_armed = false;
+	m_matching = false;
+	m_completions++;
+	return true;
+}
+
+void OrientationMatch::reset()
+{
+	m_armed = false;
+	m_matching = false;
+}
+
+void OrientationMatch::printStatistics()
+{
+	if (m_threshold <= 0.0)
+		return;
+
+	cout << "Orientation match: " << (m_shape ? "shape" : "pips") << ", " << m_completions
+		<< " trials completed within " << m_threshold * 57.29577951308232 << " deg for "
+		<< m_holdTime << " s" << endl;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <iostream>
+#include "chai3d.h"
+
+using namespace std;
+
+// How well the manipulated dice matches the reference dice.
+//
+// angle() returns the geodesic angle [rad] of the rotation between the
+// two orientations, D = R_ref^T * R_act.  With m_shape on, the dice is
+// treated as a plain cube: every one of its 24 rotational symmetries S
+// makes an equally good target, and the angle is the one to the nearest
+// of them.  Since the angle of D * S grows as trace(D * S) falls, only
+// the largest of the 24 traces is needed; each trace is a dot product of
+// the 9 entries of D with one row of a fixed table (the symmetries are
+// signed permutation matrices), evaluated two at a time with SSE2 and
+// reduced with max, without branches.  With m_shape off (the default)
+// the pips make every face distinct and only the identity is a match.
+//
+// The score can also complete a trial: update() tells the state machine
+// when the dice has stayed within m_threshold of the target, released,
+// for m_holdTime.  Only a dice that has been held since the start of the
+// trial counts, so a target the reset dice already matches does not
+// complete the trial on its own.  angle() may be called from any thread;
+// update(), reset() and the counters belong to the thread running the
+// trials.
+class OrientationMatch
+{
+public:
+	bool m_shape;			// match modulo the 24 rotations of the cube
+	double m_threshold;		// angle [rad] that completes a trial, 0 for never
+	double m_holdTime;		// time [s] the match must hold before the trial completes
+
+public:
+	OrientationMatch();
+
+public:
+	double angle(const chai3d::cMatrix3d& actual, const chai3d::cMatrix3d& reference) const;
+
+	// true once angle <= m_threshold has held, with the dice released after
+	// it was held in this trial, for m_holdTime; time [s] is the time of the
+	// tick, the recorded one in a replay, so a replay completes on the same tick
+	bool update(double angle, bool released, double time);
+	void reset();		// start of a trial: forget the running match
+
+	void printStatistics();
+
+private:
+	bool m_armed;			// the dice has been held in this trial
+	bool m_matching;		// the angle is within m_threshold, with the dice released
+	double m_matchedSince;	// time [s] the current match started
+	unsigned long long m_completions;	// trials completed by a match
+};
@@ -0,0 +1,85 @@
+#include "PosePredictor.h"
+#include <cstdio>
+
+using namespace chai3d;
+
+
+PosePredictor::PosePredictor()
+{
+	m_enabled = true;
+	m_horizon = -1.0;
+	m_maxPrediction = 0.05;
+
+	m_frameStart = 0;
+	m_presentLatency = 0;
+	m_horizonNs = 0;
+}
+
+void PosePredictor::beginFrame(unsigned long long frameStart, unsigned long long presentLatency)
+{
+	m_frameStart = frameStart;
+	m_presentLatency = presentLatency;
+	m_horizonNs = (m_horizon < 0.0) ? presentLatency : (unsigned long long)(m_horizon * 1e9);
+}
+
+void PosePredictor::predict(unsigned long long time, const cVector3d& linVel, const cVector3d& angVel,
+	cVector3d& pos, cMatrix3d& rot)
+{
+	// a pose at rest is drawn as it is, however old (the dice nobody holds)
+	if (linVel.lengthsq() == 0.0 && angVel.lengthsq() == 0.0)
+		return;
+
+	// a pose stored after the frame started is not older than the frame
+	unsigned long long age = (m_frameStart > time) ? m_frameStart - time : 0;
+	m_poseAge.record(age);
+	m_motionToPhoton.record(age + m_presentLatency);
+
+	if (!m_enabled)
+		return;
+
+	unsigned long long ahead = age + m_horizonNs;
+	double dt = ahead / 1e9;
+	if (dt > m_maxPrediction)
+		dt = m_maxPrediction;
+	m_prediction.record((unsigned long long)(dt * 1e9));
+
+	pos = cAdd(pos, cMul(dt, linVel));
+
+	double speed = angVel.length();
+	if (speed * dt > 1e-9)
+		rot.rotateAboutGlobalAxisRad(cMul(1.0 / speed, angVel), speed * dt);
+}
+
+string PosePredictor::getSummary() const
+{
+	char text[256];
+	sprintf(text, "motion-to-photon p50 %.1f ms (pose age %.1f ms), predicted %.1f ms",
+		m_motionToPhoton.getPercentile(50.0) / 1e6, m_poseAge.getPercentile(50.0) / 1e6,
+		m_enabled ? m_prediction.getPercentile(50.0) / 1e6 : 0.0);
+	return text;
+}
+
+void PosePredictor::printStatistics(ostream& out) const
+{
+	if (m_motionToPhoton.getCount() == 0)
+		return;
+
+	char line[256];
+
+	out << "Pose prediction: " << (m_enabled ? "on" : "off") << ", " << getSummary() << endl;
+	sprintf(line, "  %-26s %12s %10s %10s %10s %10s %10s", "pose [us]", "count", "mean", "p50", "p99", "p99.9", "max");
+	out << line << endl;
+
+	const char* names[] = { "age", "motion-to-photon", "prediction" };
+	const LatencyHistogram* histograms[] = { &m_poseAge, &m_motionToPhoton, &m_prediction };
+	for (int i = 0; i < 3; i++)
+	{
+		const LatencyHistogram& h = *histograms[i];
+		if (h.getCount() == 0)
+			continue;
+		sprintf(line, "  %-26s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f", names[i], h.getCount(),
+			h.getMean() / 1e3, h.getPercentile(50.0) / 1e3, h.getPercentile(99.0) / 1e3,
+			h.getPercentile(99.9) / 1e3, h.getMax() / 1e3);
+		out << line << endl;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include "chai3d.h"
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+// Extrapolates the poses published by the haptic threads to the time the
+// frame being drawn reaches the screen.
+//
+// A pose published at time t with linear velocity v and angular velocity
+// w (world coordinates) is drawn at
+//
+//	pos + v * dt,  rot turned about w by |w| * dt,  dt = frame start - t + horizon
+//
+// where the horizon is the time from the start of the frame to its
+// display: m_horizon, or the measured present latency of the frames
+// (FramePacer) when m_horizon is negative.  dt is capped at
+// m_maxPrediction, so a stalled haptic thread does not fling the dice
+// across the screen.
+//
+// Poses at rest (zero velocities) are drawn as they are and not counted.
+// For every moving pose the motion-to-photon latency is estimated as
+// the age of the pose at the start of the frame plus the present latency.
+// The part of it that prediction covers is recorded as well.  Graphics
+// thread only; the statistics may be read from any thread.
+class PosePredictor
+{
+public:
+	bool m_enabled;			// false: draw the poses as published
+	double m_horizon;		// time [s] from the start of a frame to its display, < 0 to measure it
+	double m_maxPrediction;	// longest extrapolation [s]
+
+public:
+	PosePredictor();
+
+public:
+	// frameStart: latencyNow() at the start of the frame, presentLatency:
+	// measured time [ns] from the start of a frame until it is presented
+	void beginFrame(unsigned long long frameStart, unsigned long long presentLatency);
+
+	// turns pos and rot, published at time, into the predicted pose
+	void predict(unsigned long long time, const chai3d::cVector3d& linVel, const chai3d::cVector3d& angVel,
+		chai3d::cVector3d& pos, chai3d::cMatrix3d& rot);
+
+	const LatencyHistogram& getMotionToPhoton() const { return m_motionToPhoton; }
+	const LatencyHistogram& getPrediction() const { return m_prediction; }
+
+	string getSummary() const;	// one line, for a label
+	void printStatistics(ostream& out) const;
+
+private:
+	unsigned long long m_frameStart;
+	unsigned long long m_presentLatency;
+	unsigned long long m_horizonNs;
+
+	LatencyHistogram m_poseAge;			// age of the poses at the start of the frames
+	LatencyHistogram m_motionToPhoton;	// pose age + present latency
+	LatencyHistogram m_prediction;		// time the poses were extrapolated by
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include "chai3d.h"
+#include "seqlock.h"
+
+// Dynamic state of the scene as the graphics thread draws it.  The haptic
+// threads own the objects of the haptic world and publish their state
+// through seqlocks; the graphics thread copies the latest complete state
+// into the objects of the display world before rendering, so the two
+// never touch the same transforms.
+//
+// The moving poses carry the time they were stored (latencyNow() [ns])
+// and their velocities in world coordinates, so that the graphics thread
+// can extrapolate them to the time the frame is displayed (see
+// PosePredictor.h).
+
+// Both dice; stored by the first station, the only one that moves them
+struct DiceSnapshot
+{
+	chai3d::cVector3d actDicePos;
+	chai3d::cMatrix3d actDiceRot;
+	chai3d::cMatrix3d refDiceRot;
+	unsigned long long time;
+	chai3d::cVector3d actDiceLinVel;
+	chai3d::cVector3d actDiceAngVel;	// [rad/s]
+};
+
+// Pose another station holding the actual dice moves it to (see
+// GrabArbiter.h); stored by the holder, applied by the first station
+struct DiceTarget
+{
+	chai3d::cVector3d pos;
+	chai3d::cMatrix3d rot;
+	chai3d::cVector3d linVel;
+	chai3d::cVector3d angVel;	// [rad/s]
+};
+
+// Tool of one station; stored by its haptic thread on every tick
+struct ToolSnapshot
+{
+	chai3d::cVector3d pos;		// proxy of the haptic point, as the cursor is drawn
+	chai3d::cMatrix3d rot;
+	unsigned long long time;
+	chai3d::cVector3d linVel;	// zero while the proxy is held on a surface
+	chai3d::cVector3d angVel;	// [rad/s]
+	bool selecting;				// the station moves the actual dice
+	bool touchingButton;
+};
+
+// Progress of the experiment; stored by the first station on every tick
+struct TrialSnapshot
+{
+	int trial;					// index of the subexperiment
+	bool buttonPressed;			// vmCONTACT: the trial time has stopped
+};
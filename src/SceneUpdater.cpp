@@ -0,0 +1,99 @@
+#include "SceneUpdater.h"
+
+using namespace chai3d;
+
+
+SceneUpdater::SceneUpdater()
+{
+	m_world = 0;
+	m_updated = 0;
+	m_skipped = 0;
+}
+
+SceneUpdater::~SceneUpdater()
+{
+	clear();
+}
+
+void SceneUpdater::clear()
+{
+	for (size_t i = 0; i < m_subtrees.size(); i++)
+		delete m_subtrees[i];
+	m_subtrees.clear();
+}
+
+void SceneUpdater::setScene(cWorld* world)
+{
+	clear();
+	m_world = world;
+
+	for (unsigned int i = 0; i < world->getNumChildren(); i++)
+	{
+		Subtree* subtree = new Subtree();
+		subtree->root = world->getChild(i);
+		subtree->always = false;
+		subtree->dirty = true;
+		m_subtrees.push_back(subtree);
+	}
+}
+
+SceneUpdater::Subtree* SceneUpdater::find(cGenericObject* object)
+{
+	// walk up to the child of the world the object hangs off
+	while (object != 0 && object->getParent() != m_world)
+		object = object->getParent();
+
+	for (size_t i = 0; i < m_subtrees.size(); i++)
+	{
+		if (m_subtrees[i]->root == object)
+			return m_subtrees[i];
+	}
+	return 0;
+}
+
+void SceneUpdater::setAlwaysDirty(cGenericObject* object)
+{
+	Subtree* subtree = find(object);
+	if (subtree != 0)
+		subtree->always = true;
+}
+
+void SceneUpdater::markDirty(cGenericObject* object)
+{
+	Subtree* subtree = find(object);
+	if (subtree != 0)
+		subtree->dirty.store(true, memory_order_release);
+	else
+		markAllDirty();	// not tracked (or the world itself): be safe
+}
+
+void SceneUpdater::markAllDirty()
+{
+	for (size_t i = 0; i < m_subtrees.size(); i++)
+		m_subtrees[i]->dirty.store(true, memory_order_release);
+}
+
+void SceneUpdater::update()
+{
+	if (m_world == 0)
+		return;
+
+	cVector3d worldPos = m_world->getGlobalPos();
+	cMatrix3d worldRot = m_world->getGlobalRot();
+
+	for (size_t i = 0; i < m_subtrees.size(); i++)
+	{
+		Subtree* subtree = m_subtrees[i];
+
+		// clear the flag first, so that a change made during the update is not lost
+		if (subtree->always || subtree->dirty.exchange(false, memory_order_acq_rel))
+		{
+			subtree->root->computeGlobalPositions(true, worldPos, worldRot);
+			m_updated++;
+		}
+		else
+		{
+			m_skipped++;
+		}
+	}
+}
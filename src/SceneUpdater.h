@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "chai3d.h"
+
+using namespace std;
+
+// Incremental replacement for world->computeGlobalPositions().
+//
+// The scene is split into the subtrees hanging directly off the world
+// (camera, light, tool, the dice, the button).  Each subtree has a dirty
+// flag; update() recomputes the global frames of the dirty subtrees only
+// and skips the rest.  Whoever changes a local transform (setLocalPos,
+// setLocalRot, setLocalTransform, rotate..., camera moves) calls
+// markDirty() with the object, from any thread.  Subtrees that move on
+// every tick (the tool) are marked as always dirty.
+//
+// Objects added to the world after setScene() are not tracked; call
+// setScene() again after changing the structure of the scene graph.
+class SceneUpdater
+{
+public:
+	SceneUpdater();
+	~SceneUpdater();
+
+public:
+	void setScene(chai3d::cWorld* world);	// track all children of the world, all dirty
+	void setAlwaysDirty(chai3d::cGenericObject* object);	// recompute on every update()
+
+	void markDirty(chai3d::cGenericObject* object);	// object or any of its descendants moved
+	void markAllDirty();
+
+	void update();	// haptic thread: recompute the dirty subtrees
+
+	unsigned long long getUpdatedSubtrees() const { return m_updated; }
+	unsigned long long getSkippedSubtrees() const { return m_skipped; }
+
+private:
+	struct Subtree
+	{
+		chai3d::cGenericObject* root;
+		bool always;
+		atomic<bool> dirty;
+	};
+
+	Subtree* find(chai3d::cGenericObject* object);
+	void clear();
+
+	chai3d::cWorld* m_world;
+	vector<Subtree*> m_subtrees;
+	unsigned long long m_updated;
+	unsigned long long m_skipped;
+};
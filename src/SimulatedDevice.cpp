@@ -0,0 +1,245 @@
+#include "SimulatedDevice.h"
+#include "LatencyHistogram.h"
+#include <chrono>
+#include <thread>
+
+using namespace chai3d;
+
+
+SimulatedDevice::SimulatedDevice(double rate)
+{
+	m_rate = rate;
+	m_realTime = true;
+
+	m_segment = 0;
+	m_step = 0;
+	m_start = 0;
+	m_maxForce = 0.0;
+	m_button = false;
+	m_pos.zero();
+	m_rot.identity();
+	m_linearVelocity.zero();
+	m_angularVelocity.zero();
+
+	// roughly a desktop device, so that the stiffness of the materials
+	// derived from the specifications stays in a sensible range
+	m_specifications.m_model = C_HAPTIC_DEVICE_VIRTUAL;
+	m_specifications.m_manufacturerName = "DiceGame";
+	m_specifications.m_modelName = "Simulated device";
+	m_specifications.m_maxLinearForce = 10.0;
+	m_specifications.m_maxAngularTorque = 0.0;
+	m_specifications.m_maxGripperForce = 0.0;
+	m_specifications.m_maxLinearStiffness = 2000.0;
+	m_specifications.m_maxAngularStiffness = 0.0;
+	m_specifications.m_maxGripperAngularDamping = 0.0;
+	m_specifications.m_maxLinearDamping = 20.0;
+	m_specifications.m_maxAngularDamping = 0.0;
+	m_specifications.m_workspaceRadius = 0.15;
+	m_specifications.m_gripperMaxAngleRad = 0.0;
+	m_specifications.m_sensedPosition = true;
+	m_specifications.m_sensedRotation = true;
+	m_specifications.m_sensedGripper = false;
+	m_specifications.m_actuatedPosition = true;
+	m_specifications.m_actuatedRotation = false;
+	m_specifications.m_actuatedGripper = false;
+	m_specifications.m_leftHand = true;
+	m_specifications.m_rightHand = true;
+
+	m_deviceAvailable = true;
+	m_deviceReady = false;
+}
+
+SimulatedDevice::~SimulatedDevice()
+{
+}
+
+bool SimulatedDevice::open()
+{
+	m_step = 0;
+	m_segment = 0;
+	m_start = 0;	// the clock starts with the first tick, not while the scene loads
+	update();
+
+	m_deviceReady = true;
+	return true;
+}
+
+bool SimulatedDevice::close()
+{
+	m_deviceReady = false;
+	return true;
+}
+
+bool SimulatedDevice::calibrate(bool /*a_forceCalibration*/)
+{
+	return m_deviceReady;
+}
+
+bool SimulatedDevice::getPosition(cVector3d& a_position)
+{
+	a_position = m_pos;
+	return m_deviceReady;
+}
+
+bool SimulatedDevice::getRotation(cMatrix3d& a_rotation)
+{
+	a_rotation = m_rot;
+	return m_deviceReady;
+}
+
+bool SimulatedDevice::getGripperAngleRad(double& a_angle)
+{
+	a_angle = 0.0;
+	return m_deviceReady;
+}
+
+bool SimulatedDevice::getUserSwitches(unsigned int& a_userSwitches)
+{
+	a_userSwitches = m_button ? 1 : 0;
+	return m_deviceReady;
+}
+
+bool SimulatedDevice::setForceAndTorqueAndGripperForce(const cVector3d& a_force, const cVector3d& /*a_torque*/, double /*a_gripperForce*/)
+{
+	if (a_force.length() > m_maxForce)
+		m_maxForce = a_force.length();
+
+	// one servo period has passed
+	m_step.store(m_step.load(memory_order_relaxed) + 1, memory_order_relaxed);
+
+	if (m_realTime)
+	{
+		if (m_start == 0)
+			m_start = latencyNow();
+
+		unsigned long long deadline = m_start + (unsigned long long)(m_step.load(memory_order_relaxed) * 1e9 / m_rate);
+		unsigned long long now;
+		while ((now = latencyNow()) < deadline)
+		{
+			if (deadline - now > 200000)
+				this_thread::sleep_for(chrono::microseconds(100));
+		}
+	}
+
+	update();
+	return m_deviceReady;
+}
+
+void SimulatedDevice::update()
+{
+	cVector3d lastPos = m_pos;
+	cMatrix3d lastRot = m_rot;
+
+	evaluate(getTime(), m_pos, m_rot, m_button);
+
+	// finite differences over one servo period, as a real device estimates them
+	if (m_step > 0)
+	{
+		m_linearVelocity = (m_pos - lastPos) * m_rate;
+
+		cVector3d axis;
+		double angle;
+		cMatrix3d delta = lastRot.getTranspose() * m_rot;
+		delta.toAxisAngle(axis, angle);
+		m_angularVelocity = lastRot * axis * (angle * m_rate);
+	}
+}
+
+void SimulatedDevice::addKeyframe(double duration, const cVector3d& pos, const cMatrix3d& rot, bool button)
+{
+	Keyframe keyframe;
+	keyframe.time = m_script.empty() ? 0.0 : m_script.back().time + duration;
+	keyframe.pos = pos;
+	keyframe.rot = rot;
+	keyframe.button = button;
+	m_script.push_back(keyframe);
+}
+
+double SimulatedDevice::getDuration() const
+{
+	return m_script.empty() ? 0.0 : m_script.back().time;
+}
+
+void SimulatedDevice::planSession(const cVector3d& dicePos, const cVector3d& buttonPos, const vector<vector<double> >& rotations)
+{
+	cMatrix3d identity;
+	identity.identity();
+
+	// approach the dice and the button from above, clear of both
+	cVector3d up(0.0, 0.0, 0.25 * dicePos.distance(buttonPos));
+	cVector3d home(0.0, 0.0, 0.0);
+
+	// orientation of the reference dice in the current trial
+	cMatrix3d target;
+	target.identity();
+
+	m_script.clear();
+	addKeyframe(0.0, home, identity, false);
+
+	for (size_t k = 0; k < rotations.size(); k++)
+	{
+		// grab the dice (reset to identity at the start of every trial) ...
+		addKeyframe(1.0, dicePos + up, identity, false);
+		addKeyframe(0.5, dicePos, identity, false);
+		addKeyframe(0.2, dicePos, identity, true);
+
+		// ... turn it to the target, with the device point as pivot ...
+		addKeyframe(1.5, dicePos, target, true);
+		addKeyframe(0.2, dicePos, target, false);
+		addKeyframe(0.5, dicePos + up, target, false);
+		addKeyframe(0.5, dicePos + up, identity, false);
+
+		// ... and push the virtual button; releasing it completes the trial
+		addKeyframe(1.0, buttonPos + up, identity, false);
+		addKeyframe(0.5, buttonPos, identity, false);
+		addKeyframe(0.3, buttonPos, identity, false);
+		addKeyframe(0.5, buttonPos + up, identity, false);
+		addKeyframe(0.5, buttonPos + up, identity, false);
+
+		target.rotateAboutLocalAxisRad(cVector3d(rotations[k][0], rotations[k][1], rotations[k][2]), rotations[k][3]);
+	}
+
+	addKeyframe(1.0, home, identity, false);
+
+	m_segment = 0;
+	update();
+}
+
+void SimulatedDevice::evaluate(double time, cVector3d& pos, cMatrix3d& rot, bool& button)
+{
+	if (m_script.empty())
+	{
+		pos.zero();
+		rot.identity();
+		button = false;
+		return;
+	}
+
+	// the clock only runs forward, so the segment is found from the last one
+	while (m_segment + 1 < m_script.size() && m_script[m_segment + 1].time <= time)
+		m_segment++;
+
+	const Keyframe& a = m_script[m_segment];
+	button = a.button;
+
+	if (m_segment + 1 == m_script.size())
+	{
+		pos = a.pos;
+		rot = a.rot;
+		return;
+	}
+
+	const Keyframe& b = m_script[m_segment + 1];
+	double s = (time - a.time) / (b.time - a.time);
+	s = s * s * (3.0 - 2.0 * s);
+
+	pos = a.pos + (b.pos - a.pos) * s;
+
+	cVector3d axis;
+	double angle;
+	cMatrix3d delta = a.rot.getTranspose() * b.rot;
+	delta.toAxisAngle(axis, angle);
+	cMatrix3d partial;
+	partial.setAxisAngleRotationRad(axis, angle * s);
+	rot = a.rot * partial;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include "chai3d.h"
+
+using namespace std;
+
+// Haptic device without hardware, for benchmarking the haptic loop, the
+// logger and the trial flow on machines without a device.
+//
+// The device plays a scripted session built by planSession(): for every
+// trial it moves to the dice, presses the user switch, turns the dice to
+// the target orientation of the trial, releases it and pushes the
+// virtual button.  Between the keyframes of the script the position is
+// interpolated with a smooth (zero velocity at both ends) profile and the
+// rotation about a fixed axis.
+//
+// The device has its own clock: every setForceAndTorqueAndGripperForce()
+// call (once per haptic tick, in tool->applyToDevice()) advances it by
+// one servo period, so the trajectory does not depend on the speed of the
+// machine.  With m_realTime the call also blocks until that period has
+// passed on the wall clock, the way the servo loop of a real device paces
+// its client; without it the session runs as fast as the loop can go.
+//
+// The positions are in device coordinates, i.e. world coordinates divided
+// by the workspace scale factor of the tool.
+class SimulatedDevice : public chai3d::cGenericHapticDevice
+{
+public:
+	double m_rate;			// servo rate [Hz]; one tick of the script per period
+	bool m_realTime;		// block each tick until its period has passed
+
+public:
+	SimulatedDevice(double rate = 1000.0);
+	virtual ~SimulatedDevice();
+
+public:
+	virtual bool open();
+	virtual bool close();
+	virtual bool calibrate(bool a_forceCalibration = false);
+
+	virtual bool getPosition(chai3d::cVector3d& a_position);
+	virtual bool getRotation(chai3d::cMatrix3d& a_rotation);
+	virtual bool getGripperAngleRad(double& a_angle);
+	virtual bool getUserSwitches(unsigned int& a_userSwitches);
+	virtual bool setForceAndTorqueAndGripperForce(const chai3d::cVector3d& a_force, const chai3d::cVector3d& a_torque, double a_gripperForce);
+
+	// script the whole experiment: one trial per rotation, the reference
+	// dice turning by the rotations (axis x, y, z, angle [rad]) as in the
+	// real experiment
+	void planSession(const chai3d::cVector3d& dicePos, const chai3d::cVector3d& buttonPos, const vector<vector<double> >& rotations);
+
+	double getTime() const { return m_step.load(memory_order_relaxed) / m_rate; }	// time of the script [s], any thread
+	double getDuration() const;		// length of the script [s]
+	bool isFinished() const { return getTime() >= getDuration(); }	// any thread
+	double getMaxForce() const { return m_maxForce; }	// largest force commanded so far [N]
+
+private:
+	struct Keyframe
+	{
+		double time;				// [s] since the start of the script
+		chai3d::cVector3d pos;
+		chai3d::cMatrix3d rot;
+		bool button;				// state of the user switch from this keyframe on
+	};
+
+	void addKeyframe(double duration, const chai3d::cVector3d& pos, const chai3d::cMatrix3d& rot, bool button);
+	void evaluate(double time, chai3d::cVector3d& pos, chai3d::cMatrix3d& rot, bool& button);
+	void update();
+
+private:
+	vector<Keyframe> m_script;
+	size_t m_segment;				// keyframe the current segment starts at
+
+	atomic<unsigned long long> m_step;	// number of ticks played (written by the haptic thread)
+	unsigned long long m_start;		// latencyNow() of the first tick, 0 before it
+	double m_maxForce;
+
+	chai3d::cVector3d m_pos;
+	chai3d::cMatrix3d m_rot;
+	bool m_button;
+};
+
+typedef shared_ptr<SimulatedDevice> SimulatedDevicePtr;
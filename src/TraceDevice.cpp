@@ -0,0 +1,266 @@
+#include "TraceDevice.h"
+#include "LatencyHistogram.h"
+#include <chrono>
+#include <thread>
+
+using namespace chai3d;
+
+
+TraceDevice::TraceDevice(cGenericHapticDevicePtr device, InputTraceWriter* writer)
+{
+	m_realTime = true;
+	m_device = device;
+	m_writer = writer;
+	m_reader = 0;
+
+	m_specifications = device->getSpecifications();
+	m_deviceAvailable = true;
+	m_deviceReady = false;
+
+	m_latched = false;
+	m_start = 0;
+	m_ticks = 0;
+	m_matchMismatches = 0;
+}
+
+TraceDevice::TraceDevice(const InputTraceReader* reader)
+{
+	m_realTime = true;
+	m_writer = 0;
+	m_reader = reader;
+
+	// the parts of the specifications that shape the scene come from the trace
+	const InputTraceDevice& device = reader->getDevice();
+	m_specifications.m_model = C_HAPTIC_DEVICE_VIRTUAL;
+	m_specifications.m_manufacturerName = "DiceGame";
+	m_specifications.m_modelName = "Replayed device";
+	m_specifications.m_workspaceRadius = device.workspaceRadius;
+	m_specifications.m_maxLinearForce = device.maxLinearForce;
+	m_specifications.m_maxLinearStiffness = device.maxLinearStiffness;
+	m_specifications.m_maxLinearDamping = device.maxLinearDamping;
+	m_specifications.m_maxAngularTorque = 0.0;
+	m_specifications.m_maxAngularStiffness = 0.0;
+	m_specifications.m_maxAngularDamping = 0.0;
+	m_specifications.m_maxGripperForce = 0.0;
+	m_specifications.m_maxGripperAngularDamping = 0.0;
+	m_specifications.m_gripperMaxAngleRad = 0.0;
+	m_specifications.m_sensedPosition = true;
+	m_specifications.m_sensedRotation = true;
+	m_specifications.m_sensedGripper = false;
+	m_specifications.m_actuatedPosition = true;
+	m_specifications.m_actuatedRotation = false;
+	m_specifications.m_actuatedGripper = false;
+	m_specifications.m_leftHand = true;
+	m_specifications.m_rightHand = true;
+	m_deviceAvailable = reader->getNumFrames() > 0;
+	m_deviceReady = false;
+
+	m_latched = false;
+	m_start = 0;
+	m_ticks = 0;
+	m_matchMismatches = 0;
+}
+
+TraceDevice::~TraceDevice()
+{
+}
+
+bool TraceDevice::open()
+{
+	m_deviceReady = m_device ? m_device->open() : m_deviceAvailable;
+	m_start = latencyNow();
+	m_latched = false;
+	m_ticks = 0;
+	m_matchMismatches = 0;
+	return m_deviceReady;
+}
+
+bool TraceDevice::close()
+{
+	m_deviceReady = false;
+	return m_device ? m_device->close() : true;
+}
+
+bool TraceDevice::calibrate(bool a_forceCalibration)
+{
+	return m_device ? m_device->calibrate(a_forceCalibration) : m_deviceReady;
+}
+
+void TraceDevice::latch()
+{
+	if (m_latched)
+		return;
+	m_latched = true;
+
+	if (m_reader != 0)
+	{
+		// past the end the device holds the last frame
+		size_t i = (size_t)getTicks();
+		if (i >= m_reader->getNumFrames())
+			i = m_reader->getNumFrames() - 1;
+		m_frame = m_reader->getFrame(i);
+		return;
+	}
+
+	m_frame.time = (latencyNow() - m_start) / 1e9;
+	m_frame.trialTime = 0.0;
+	m_device->getPosition(m_frame.position);
+	m_device->getRotation(m_frame.rotation);
+	m_device->getLinearVelocity(m_frame.linearVelocity);
+	m_device->getAngularVelocity(m_frame.angularVelocity);
+	m_device->getGripperAngleRad(m_frame.gripperAngle);
+	m_device->getUserSwitches(m_frame.userSwitches);
+	m_frame.flags = 0;
+	m_frame.toolRotation.identity();
+	m_frame.refDiceAngles.zero();
+}
+
+bool TraceDevice::getPosition(cVector3d& a_position)
+{
+	latch();
+	a_position = m_frame.position;
+	return m_deviceReady;
+}
+
+bool TraceDevice::getRotation(cMatrix3d& a_rotation)
+{
+	latch();
+	a_rotation = m_frame.rotation;
+	return m_deviceReady;
+}
+
+bool TraceDevice::getLinearVelocity(cVector3d& a_linearVelocity)
+{
+	latch();
+	a_linearVelocity = m_frame.linearVelocity;
+	return m_deviceReady;
+}
+
+bool TraceDevice::getAngularVelocity(cVector3d& a_angularVelocity)
+{
+	latch();
+	a_angularVelocity = m_frame.angularVelocity;
+	return m_deviceReady;
+}
+
+bool TraceDevice::getGripperAngleRad(double& a_angle)
+{
+	latch();
+	a_angle = m_frame.gripperAngle;
+	return m_deviceReady;
+}
+
+bool TraceDevice::getUserSwitches(unsigned int& a_userSwitches)
+{
+	latch();
+	a_userSwitches = m_frame.userSwitches;
+	return m_deviceReady;
+}
+
+bool TraceDevice::setForceAndTorqueAndGripperForce(const cVector3d& a_force, const cVector3d& a_torque, double a_gripperForce)
+{
+	if (m_device)
+		return m_device->setForceAndTorqueAndGripperForce(a_force, a_torque, a_gripperForce);
+	return m_deviceReady;
+}
+
+double TraceDevice::traceTrialTime(double trialTime)
+{
+	latch();
+	if (m_reader == 0)
+		m_frame.trialTime = trialTime;
+	return m_frame.trialTime;
+}
+
+bool TraceDevice::traceTrialStart(bool started)
+{
+	latch();
+	if (m_reader == 0 && started)
+		m_frame.flags |= INPUT_TRACE_TRIAL_START;
+	return (m_frame.flags & INPUT_TRACE_TRIAL_START) != 0;
+}
+
+bool TraceDevice::traceToolRotation(bool rotated, cMatrix3d& rotation)
+{
+	latch();
+	if (m_reader == 0 && rotated)
+	{
+		m_frame.flags |= INPUT_TRACE_TOOL_ROTATION;
+		m_frame.toolRotation = rotation;
+	}
+	if ((m_frame.flags & INPUT_TRACE_TOOL_ROTATION) == 0)
+		return false;
+	rotation = m_frame.toolRotation;
+	return true;
+}
+
+bool TraceDevice::traceRefDiceTurn(bool turned, cVector3d& angles)
+{
+	latch();
+	if (m_reader == 0 && turned)
+	{
+		m_frame.flags |= INPUT_TRACE_REF_DICE_TURN;
+		m_frame.refDiceAngles = angles;
+	}
+	if ((m_frame.flags & INPUT_TRACE_REF_DICE_TURN) == 0)
+		return false;
+	angles = m_frame.refDiceAngles;
+	return true;
+}
+
+bool TraceDevice::traceReset(bool reset)
+{
+	latch();
+	if (m_reader == 0 && reset)
+		m_frame.flags |= INPUT_TRACE_RESET;
+	return (m_frame.flags & INPUT_TRACE_RESET) != 0;
+}
+
+void TraceDevice::checkMatch(bool matched)
+{
+	latch();
+	if (m_reader == 0)
+	{
+		if (matched)
+			m_frame.flags |= INPUT_TRACE_MATCH;
+	}
+	else if (matched != ((m_frame.flags & INPUT_TRACE_MATCH) != 0))
+	{
+		m_matchMismatches.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+double TraceDevice::getTickTime()
+{
+	latch();
+	return m_frame.time;
+}
+
+void TraceDevice::endTick()
+{
+	latch();
+	if (m_writer != 0)
+		m_writer->push(m_frame);
+
+	unsigned long long tick = getTicks() + 1;
+	m_ticks.store(tick, memory_order_relaxed);
+	m_latched = false;
+
+	// wait for the time of the next frame, relative to the first one
+	if (m_reader != 0 && m_realTime && tick < m_reader->getNumFrames())
+	{
+		double due = m_reader->getFrame((size_t)tick).time - m_reader->getFrame(0).time;
+		unsigned long long deadline = m_start + (unsigned long long)(due * 1e9);
+		unsigned long long now;
+		while ((now = latencyNow()) < deadline)
+		{
+			if (deadline - now > 200000)
+				this_thread::sleep_for(chrono::microseconds(100));
+		}
+	}
+}
+
+bool TraceDevice::isFinished() const
+{
+	return m_reader != 0 && getTicks() >= m_reader->getNumFrames();
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+#include <atomic>
+#include "chai3d.h"
+#include "InputTrace.h"
+
+using namespace std;
+
+// Haptic device that records the inputs of the haptic loop to a trace, or
+// replays them from one (see InputTrace.h for the file format).
+//
+// Recording wraps the real device.  The first read of a tick latches all
+// inputs of the device at once (position, rotation, velocities, gripper,
+// user switches), and every later read in the same tick returns the
+// latched values, so the tool and the logger see the same sample and the
+// trace holds exactly what the loop saw.  endTick() hands the frame to
+// the InputTraceWriter.
+//
+// Replaying returns the recorded frames instead, one per tick, either as
+// fast as the loop runs or (m_realTime) paced to the recorded timestamps.
+//
+// Besides the device, the loop has inputs that depend on timing: the
+// trial timer, the tick on which the controller's next trial arrived, and
+// the requests of the graphics thread (the tool lined up with the camera,
+// the reference dice turned with the space key, the world reset from the
+// menu) with the ticks they were applied on.  The loop passes them through
+// the trace...() methods, which store them while recording and return the
+// recorded values while replaying; a replay ignores the live requests.
+// So a replay reproduces the session bit for bit.  What the loop decides
+// from those inputs is checked instead: checkMatch() records the ticks a
+// match with the reference completed a trial, and a replay counts the
+// ticks on which it decides otherwise.
+class TraceDevice : public chai3d::cGenericHapticDevice
+{
+public:
+	bool m_realTime;		// replay: pace the frames to their timestamps
+
+public:
+	TraceDevice(chai3d::cGenericHapticDevicePtr device, InputTraceWriter* writer);	// record
+	TraceDevice(const InputTraceReader* reader);	// replay
+	virtual ~TraceDevice();
+
+public:
+	virtual bool open();
+	virtual bool close();
+	virtual bool calibrate(bool a_forceCalibration = false);
+
+	virtual bool getPosition(chai3d::cVector3d& a_position);
+	virtual bool getRotation(chai3d::cMatrix3d& a_rotation);
+	virtual bool getLinearVelocity(chai3d::cVector3d& a_linearVelocity);
+	virtual bool getAngularVelocity(chai3d::cVector3d& a_angularVelocity);
+	virtual bool getGripperAngleRad(double& a_angle);
+	virtual bool getUserSwitches(unsigned int& a_userSwitches);
+	virtual bool setForceAndTorqueAndGripperForce(const chai3d::cVector3d& a_force, const chai3d::cVector3d& a_torque, double a_gripperForce);
+
+	double traceTrialTime(double trialTime);	// reading of the trial timer in this tick
+	bool traceTrialStart(bool started);			// whether the next trial starts in this tick
+	bool traceToolRotation(bool rotated, chai3d::cMatrix3d& rotation);	// whether (and how) the tool is turned in this tick
+	bool traceRefDiceTurn(bool turned, chai3d::cVector3d& angles);		// whether (and by how much) the reference dice turns
+	bool traceReset(bool reset);				// whether the world is reset from the menu in this tick
+	void checkMatch(bool matched);				// whether a match completed the trial in this tick
+	double getTickTime();	// time [s] of this tick since the start of the recording, the recorded one while replaying
+	void endTick();		// end of the loop iteration
+
+	bool isReplaying() const { return m_reader != 0; }
+	bool isFinished() const;	// replay: all frames played (any thread)
+	unsigned long long getTicks() const { return m_ticks.load(memory_order_relaxed); }
+	unsigned long long getMatchMismatches() const { return m_matchMismatches.load(memory_order_relaxed); }	// replay: ticks that matched otherwise than recorded
+
+private:
+	void latch();
+
+private:
+	chai3d::cGenericHapticDevicePtr m_device;	// recording
+	InputTraceWriter* m_writer;
+	const InputTraceReader* m_reader;			// replaying
+
+	InputFrame m_frame;		// inputs of the current tick
+	bool m_latched;
+	unsigned long long m_start;		// latencyNow() of the first tick
+	atomic<unsigned long long> m_ticks;
+	atomic<unsigned long long> m_matchMismatches;
+};
+
+typedef shared_ptr<TraceDevice> TraceDevicePtr;
@@ -0,0 +1,113 @@
+#include "TrialController.h"
+#include "LatencyHistogram.h"
+#include <chrono>
+
+using namespace chai3d;
+
+
+TrialController::TrialController()
+{
+	m_generation = 0;
+	m_seenGeneration = 0;
+	m_stopRequested = false;
+	m_pending = false;
+	m_finished = false;
+	m_trials = 0;
+	m_maxTurnaround = 0;
+}
+
+bool TrialController::post(const TrialEvent& event)
+{
+	if (!m_events.try_push(event))
+		return false;
+
+	// the flag is set before the notification, so run() sees it whether it
+	// checks before or after; passing through the mutex (only if it is free,
+	// the haptic thread never waits for it) orders the notification after
+	// a check in progress.  The timeout of run() remains as a bound.
+	m_pending.store(true, memory_order_release);
+	if (m_mutex.try_lock())
+		m_mutex.unlock();
+	m_eventReady.notify_one();
+	return true;
+}
+
+bool TrialController::poll(TrialTarget& target)
+{
+	unsigned int generation = m_generation.load(memory_order_acquire);
+	if (generation == m_seenGeneration)
+		return false;
+
+	target = m_targets[generation & 1];
+	m_seenGeneration = generation;
+	return true;
+}
+
+void TrialController::run()
+{
+	while (!m_stopRequested)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_eventReady.wait_for(lock, chrono::milliseconds(WAIT_TIMEOUT_MS), [this] { return m_stopRequested || m_pending.load(memory_order_acquire); });
+		}
+
+		// cleared before draining: an event posted from here on sets it again
+		m_pending.exchange(false, memory_order_acq_rel);
+
+		TrialEvent* events;
+		size_t count;
+		while ((count = m_events.peek(events)) > 0)
+		{
+			for (size_t i = 0; i < count; i++)
+				handle(events[i]);
+			m_events.pop(count);
+		}
+	}
+
+	m_finished = true;
+}
+
+void TrialController::handle(const TrialEvent& event)
+{
+	// the next trial starts from the orientation of this one, turned by its rotation
+	const vector<double>& rotation = m_rotations[event.trial];
+
+	unsigned int generation = m_generation.load(memory_order_relaxed) + 1;
+	TrialTarget& target = m_targets[generation & 1];
+	target.trial = event.trial + 1;
+	target.refDiceRotation = event.refDiceRotation;
+	target.refDiceRotation.rotateAboutLocalAxisRad(cVector3d(rotation[0], rotation[1], rotation[2]), rotation[3]);
+	m_generation.store(generation, memory_order_release);
+
+	unsigned long long turnaround = latencyNow() - event.timestamp;
+	if (turnaround > m_maxTurnaround)
+		m_maxTurnaround = turnaround;
+	m_trials++;
+
+	// time measurement
+	cout << "Elapsed time: " << event.completionTime << endl;
+}
+
+void TrialController::stop()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopRequested = true;
+	}
+	m_eventReady.notify_one();
+}
+
+bool TrialController::isFinished()
+{
+	return m_finished;
+}
+
+void TrialController::printStatistics()
+{
+	if (m_events.dropped() > 0)
+		cerr << "Warning: " << m_events.dropped() << " trial event(s) were dropped!" << endl;
+
+	cout << "Trial controller: " << getCompletedTrials() << " trial(s) completed, longest turnaround "
+		<< m_maxTurnaround / 1e6 << " ms" << endl;
+}
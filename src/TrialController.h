@@ -0,0 +1,85 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "chai3d.h"
+#include "spsc_ring.h"
+
+using namespace std;
+
+// Event posted by the haptic thread when the participant releases the
+// virtual button
+struct TrialEvent
+{
+	int trial;					// index of the subexperiment that was completed
+	double completionTime;		// trial time [s] when the button was pressed
+	unsigned long long timestamp;	// latencyNow() when the button was released
+	chai3d::cMatrix3d refDiceRotation;	// orientation of the reference dice during the trial
+};
+
+// Target of the next subexperiment, published back to the haptic thread
+struct TrialTarget
+{
+	int trial;					// index of the subexperiment to start
+	chai3d::cMatrix3d refDiceRotation;	// orientation of the reference dice
+};
+
+// Runs the trial bookkeeping outside the haptic loop.
+//
+// The haptic thread only calls post() when a trial is completed, which
+// copies the event into a lock-free ring, and poll() on every tick.  The
+// controller thread runs run(): it sleeps until an event arrives, computes
+// the orientation of the reference dice for the next trial, prints the
+// completion time and publishes the new target.  poll() picks the target
+// up with one atomic load.
+//
+// The targets are double buffered: the controller fills the slot that is
+// not current and then bumps the generation with a release store.  The
+// haptic thread posts one event per trial and waits for its target, so
+// the controller never overwrites a slot that is still being read.
+class TrialController
+{
+public:
+	enum { EVENT_RING_SIZE = 16, WAIT_TIMEOUT_MS = 100 };
+
+	vector<vector<double> > m_rotations;	// rotation of the reference dice after each trial (axis x, y, z, angle [rad])
+
+public:
+	TrialController();
+
+public:
+	bool post(const TrialEvent& event);	// haptic thread: never blocks
+	bool poll(TrialTarget& target);		// haptic thread: true if a new target was published
+	bool isReady() const { return m_generation.load(memory_order_acquire) != m_seenGeneration; }	// haptic thread: poll() would return true
+
+	void run();				// controller thread: handle events until stop() is called
+	void stop();			// ask run() to return
+	bool isFinished();		// true once run() has returned
+
+	unsigned int getCompletedTrials() const { return m_trials; }	// any thread
+	void printStatistics();
+
+private:
+	void handle(const TrialEvent& event);
+
+private:
+	spsc_ring<TrialEvent, EVENT_RING_SIZE> m_events;
+
+	TrialTarget m_targets[2];
+	atomic<unsigned int> m_generation;	// written by the controller thread
+	unsigned int m_seenGeneration;		// haptic thread only
+
+	// sleeping/waking the controller thread; the haptic thread never waits
+	// for the mutex, it only sets the flag and notifies
+	mutex m_mutex;
+	condition_variable m_eventReady;
+	atomic<bool> m_pending;		// an event was posted since run() last drained the ring
+
+	atomic<bool> m_stopRequested;
+	atomic<bool> m_finished;
+
+	atomic<unsigned int> m_trials;
+	unsigned long long m_maxTurnaround;	// longest time from a release to its published target [ns]
+};
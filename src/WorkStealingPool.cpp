@@ -0,0 +1,114 @@
+#include "WorkStealingPool.h"
+
+
+WorkStealingPool::WorkStealingPool(unsigned int numThreads)
+{
+	if (numThreads == 0)
+		numThreads = thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+
+	m_queued = 0;
+	m_pending = 0;
+	m_next = 0;
+	m_steals = 0;
+	m_stop = false;
+
+	for (unsigned int i = 0; i < numThreads; i++)
+		m_queues.push_back(new Queue());
+	for (unsigned int i = 0; i < numThreads; i++)
+		m_threads.push_back(thread(&WorkStealingPool::run, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	for (size_t i = 0; i < m_queues.size(); i++)
+		delete m_queues[i];
+}
+
+void WorkStealingPool::submit(const function<void()>& task)
+{
+	++m_pending;
+
+	Queue* queue = m_queues[m_next++ % m_queues.size()];
+	{
+		lock_guard<mutex> lock(queue->lock);
+		queue->tasks.push_back(task);
+	}
+	++m_queued;
+
+	// taking the lock orders this with a worker that is about to sleep
+	lock_guard<mutex> lock(m_mutex);
+	m_wake.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+void WorkStealingPool::run(unsigned int id)
+{
+	for (;;)
+	{
+		function<void()> task;
+		if (pop(id, task) || steal(id, task))
+		{
+			task();
+
+			if (--m_pending == 0)
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_done.notify_all();
+			}
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_mutex);
+		if (m_stop)
+			return;
+		m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+	}
+}
+
+bool WorkStealingPool::pop(unsigned int id, function<void()>& task)
+{
+	Queue* queue = m_queues[id];
+	lock_guard<mutex> lock(queue->lock);
+	if (queue->tasks.empty())
+		return false;
+
+	// newest first: it is the most likely to touch data that is still in cache
+	task.swap(queue->tasks.back());
+	queue->tasks.pop_back();
+	--m_queued;
+	return true;
+}
+
+bool WorkStealingPool::steal(unsigned int id, function<void()>& task)
+{
+	for (size_t i = 1; i < m_queues.size(); i++)
+	{
+		Queue* queue = m_queues[(id + i) % m_queues.size()];
+		lock_guard<mutex> lock(queue->lock);
+		if (queue->tasks.empty())
+			continue;
+
+		// oldest first, the end of the queue its owner doesn't work on
+		task.swap(queue->tasks.front());
+		queue->tasks.pop_front();
+		--m_queued;
+		++m_steals;
+		return true;
+	}
+	return false;
+}
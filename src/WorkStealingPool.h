@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed-size thread pool with one task queue per worker.
+//
+// Tasks are dealt round-robin to the queues.  A worker takes its own
+// tasks from the back of its queue and, once that is empty, steals from
+// the front of the other queues, so that a few long tasks (a big file)
+// do not leave the other workers idle while short ones pile up behind
+// them.  Tasks may submit more tasks.  Idle workers sleep on a
+// condition variable.
+class WorkStealingPool
+{
+public:
+	WorkStealingPool(unsigned int numThreads);	// 0 = one per hardware thread
+	~WorkStealingPool();
+
+public:
+	void submit(const function<void()>& task);
+	void wait();	// until every submitted task, including the ones they submitted, has finished
+
+	unsigned int getNumThreads() const { return (unsigned int)m_threads.size(); }
+	unsigned long long getSteals() const { return m_steals; }
+
+private:
+	struct Queue
+	{
+		mutex lock;
+		deque<function<void()> > tasks;
+	};
+
+	void run(unsigned int id);
+	bool pop(unsigned int id, function<void()>& task);
+	bool steal(unsigned int id, function<void()>& task);
+
+	vector<Queue*> m_queues;
+	vector<thread> m_threads;
+
+	mutex m_mutex;
+	condition_variable m_wake;		// a task was queued, or the pool stops
+	condition_variable m_done;		// m_pending dropped to 0
+	atomic<size_t> m_queued;		// tasks waiting in the queues
+	atomic<size_t> m_pending;		// tasks submitted and not yet finished
+	atomic<unsigned int> m_next;	// queue for the next submit
+	atomic<unsigned long long> m_steals;
+	bool m_stop;
+
+	WorkStealingPool(const WorkStealingPool&);
+	WorkStealingPool& operator=(const WorkStealingPool&);
+};
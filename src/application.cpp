@@ -18,16 +18,23 @@ Features:
 - GLUT menu is created and attached to right mouse click
 - Left mouse click is assigned to rotating the camera
 - Space key (key = 32) is used to load a new reference dice orientation
-
-\todo
-- Multi-finger support
+- Several haptic devices (DEVICES), each with its own tool, haptic thread and data file
 
 */
 //==============================================================================
 
 //------------------------------------------------------------------------------
 #include "chai3d.h"
-#include "block_linked_list.h"
+#include "HapticStation.h"
+#include "GrabArbiter.h"
+#include "SceneUpdater.h"
+#include "SceneSnapshot.h"
+#include "TrialController.h"
+#include "OrientationMatch.h"
+#include "FramePacer.h"
+#include "PosePredictor.h"
+#include "SimulatedDevice.h"
+#include "TraceDevice.h"
 #include "ConfFile.h"
 //------------------------------------------------------------------------------
 using namespace chai3d;
@@ -64,9 +71,12 @@ bool mirroredDisplay = false;
 // DECLARED VARIABLES
 //------------------------------------------------------------------------------
 
-// a world that contains all objects of the virtual environment
+// a world that contains all objects of the virtual environment (haptic threads only)
 cWorld* world;
 
+// the copy of the world that is drawn (graphics thread only)
+cWorld* displayWorld;
+
 // a camera to render the world in the window display
 cCamera* camera;
 
@@ -76,14 +86,46 @@ cDirectionalLight *light;
 // a haptic device handler
 cHapticDeviceHandler* handler;
 
-// a pointer to the current haptic device
-cGenericHapticDevicePtr hapticDevice;
+// scripted devices used instead of the hardware (DEVICE SIMULATED or --sim), one per station
+vector<SimulatedDevicePtr> simulatedDevices;
+
+// recording or replay of the device inputs (TRACE, --record, --replay)
+TraceDevicePtr traceDevice;
+InputTraceWriter traceWriter;
+InputTraceReader traceReader;
+
+// run the experiment without window and rendering (--headless)
+bool headless = false;
+
+// one station per haptic device: device, tool, haptic thread and log stream
+vector<HapticStation*> stations;
+
+// decides which station holds the actual dice
+GrabArbiter diceArbiter;
+
+// angle between the actual and the reference dice, optionally completes trials
+OrientationMatch orientationMatch;
 
 // a label to display the rate [Hz] at which the simulation is running
 cLabel* labelHapticRate;
 
-// a small sphere (cursor) representing the haptic device 
-cToolCursor* tool;
+// a label to display the latency of the haptic loop
+cLabel* labelHapticLatency;
+
+// a label to display the progress of the experiment
+cLabel* labelTrial;
+
+// a label to display the frame rate and times of the graphics loop
+cLabel* labelFrames;
+
+// a label to display the estimated motion-to-photon latency
+cLabel* labelMotionToPhoton;
+
+// paces and times the frames of the graphics loop
+FramePacer framePacer;
+
+// extrapolates the dice and the tools to the time the frame is displayed
+PosePredictor posePredictor;
 
 // reference dice model
 cMultiMesh* refDice;
@@ -97,17 +139,28 @@ cMesh* boundingSphere;
 // virtual button
 cMesh* virtualButton;
 
-// selected object
-cGenericObject* selectedObject = NULL;
+// copies of the objects in the display world
+cMultiMesh* displayRefDice;
+cMultiMesh* displayActDice;
+cMesh* displayBoundingSphere;
+cMesh* displayButton;
+vector<cShapeSphere*> displayTools;
 
-// flag to indicate if the haptic simulation currently running
-bool simulationRunning = false;
+// state of the scene, published by the haptic threads for the graphics thread
+// (and for the other stations)
+seqlock<DiceSnapshot> diceSnapshot;
+seqlock<TrialSnapshot> trialSnapshot;
 
-// flag to indicate if the haptic simulation has terminated
-bool simulationFinished = false;
+// requests of the graphics thread to the haptic threads
+seqlock<cMatrix3d> toolRotation;		// orientation of the tools, lined up with the camera
+seqlock<cVector3d> refDiceRequest;		// extrinsic Euler angles [deg] to turn the reference dice by
+seqlock<bool> resetRequest;				// put the manipulated dice back (menu); only the version counts
 
-// frequency counter to measure the simulation haptic rate
-cFrequencyCounter frequencyCounter;
+// pose of the actual dice asked for by the station holding it, for the first station
+seqlock<DiceTarget> diceTarget;
+
+// flag to indicate if the haptic simulation currently running
+bool simulationRunning = false;
 
 // last mouse position
 int mouseX;
@@ -140,27 +193,17 @@ bool virtualButtonDown = false;
 // contact state of virtual button
 bool previousContactState = false;
 
-struct HapticData{
-	double    time;
-	cMatrix3d refDiceOrientation;
-	cVector3d actDicePos;
-	cMatrix3d actDiceOrientation;
-	cMatrix3d deviceOrientation;
-	cVector3d devicePos;
-	cVector3d deviceVel;
-};
-
-// buffer for storing data temporarily
-block_linked_list<HapticData, (size_t)1000> dataBuffer;
+// recomputes the global frames of the parts of the scene that moved
+SceneUpdater sceneUpdater;
 
-// file to log data
-FILE* dataFile;
+// trial transitions, off the haptic thread
+TrialController trialController;
 
 // clock for measuring the timing of the experiment
 cPrecisionClock timer;
 
-// index of the current subexperiment
-int indSubExp = 0;
+// index of the current subexperiment (written by the first station)
+atomic<int> indSubExp(0);
 
 // configuration file for the experiment
 ConfFile config;
@@ -190,8 +233,17 @@ void graphicsTimer(int data);
 // function that closes the application
 void close(void);
 
-// main haptics simulation loop
-void updateHaptics(void);
+// main haptics simulation loop of a station
+void updateHaptics(void* arg);
+
+// trial bookkeeping between the subexperiments
+void controlTrials(void);
+
+// waits for the experiment to finish when there is no window; returns the exit code
+int runHeadless(void);
+
+// writes the recorded input trace
+void writeTrace(void);
 
 // application menu
 void createMenu(void);
@@ -202,12 +254,18 @@ void processMenuEvents(int option);
 // callback to log data
 void logData(void);
 
-// callback to flush logged data
-void flushData(void);
+// callback to flush logged data of a station
+void flushData(void* arg);
 
 // Reset object position and orientation
 void resetWorld(void);
 
+// publish the pose of the dice (by the first station)
+void publishDice(const cVector3d& linVel = cVector3d(0, 0, 0), const cVector3d& angVel = cVector3d(0, 0, 0));
+
+// move the actual dice to the last target of its holder, if not done yet (by the first station)
+bool applyDiceTarget(unsigned int& seenVersion);
+
 enum cMode
 {
 	IDLE,
@@ -217,7 +275,8 @@ enum cMode
 enum cVirtualMode
 {
 	vmIDLE,
-	vmCONTACT
+	vmCONTACT,
+	vmWAIT		// button released, waiting for the next trial from the controller
 };
 
 enum menuItem
@@ -268,65 +327,155 @@ int main(int argc, char* argv[])
 	//--------------------------------------------------------------------------
 	// OPEN CONFIGURATION FILE
 	//--------------------------------------------------------------------------
-	config.openConfFile("C:/Users/nm911876/Desktop/Projects/DiceGame/bin/win-x64/experiment.conf");
+	string confFileName = "C:/Users/nm911876/Desktop/Projects/DiceGame/bin/win-x64/experiment.conf";
+	bool simulate = false;
+	bool fast = false;
+	int numDevices = 0;
+	string recordFile, replayFile;
+	string collision;
+
+	// command line options override the configuration file
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--config" && i + 1 < argc)
+			confFileName = argv[++i];
+		else if (arg == "--sim")
+			simulate = true;
+		else if (arg == "--headless")
+			headless = true;
+		else if (arg == "--record" && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (arg == "--replay" && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (arg == "--fast")
+			fast = true;
+		else if (arg == "--devices" && i + 1 < argc)
+			numDevices = atoi(argv[++i]);
+		else if (arg == "--collision" && i + 1 < argc)
+			collision = argv[++i];
+	}
+
+	config.openConfFile(confFileName);
 	cout << config.m_numSubExp << " configuration(s) is/are loaded." << endl;
+	if (simulate)
+		config.m_device = "SIMULATED";
+	if (!recordFile.empty())
+	{
+		config.m_traceMode = "RECORD";
+		config.m_traceFile = recordFile;
+	}
+	if (!replayFile.empty())
+	{
+		config.m_traceMode = "REPLAY";
+		config.m_traceFile = replayFile;
+	}
+	if (fast)
+		config.m_traceRealTime = false;
+	if (numDevices > 0)
+		config.m_numDevices = numDevices;
+	if (collision == "MESH" || collision == "ANALYTIC")
+		config.m_collision = collision;
+	else if (!collision.empty())
+		cerr << "Warning: Unknown collision mode " << collision << ", using " << config.m_collision << "!" << endl;
+	if (config.m_traceMode != "OFF" && config.m_numDevices > 1)
+	{
+		cerr << "Warning: Input traces hold a single device, only the first device is used!" << endl;
+		config.m_numDevices = 1;
+	}
 	//config.printConfigurations();
 
 	//--------------------------------------------------------------------------
-	// OPEN FILE FOR DATA RECORDING
+	// OPEN FILES FOR DATA RECORDING
 	//--------------------------------------------------------------------------
-	dataFile = fopen("data.hdata", "wb");
-	if (dataFile == 0)
+	trialController.m_rotations = config.m_rotations;
+	orientationMatch.m_shape = config.m_matchShape;
+	orientationMatch.m_threshold = config.m_matchThreshold;
+	orientationMatch.m_holdTime = config.m_matchHoldTime;
+	for (int i = 0; i < config.m_numDevices; i++)
 	{
-		cerr << "Error: Output data file could not be opened!";
-		return -1;
+		HapticStation* station = new HapticStation();
+		station->index = i;
+		stations.push_back(station);
+
+		DataLogger& dataLogger = station->dataLogger;
+		dataLogger.m_maxFlushLatency = config.m_flushLatency;
+		dataLogger.m_float32 = config.m_logFloat32;
+		dataLogger.m_delta = config.m_logDelta;
+		dataLogger.m_precision = config.m_logPrecision;
+		dataLogger.m_writerBackend = config.m_logWriter;
+		dataLogger.m_trialRotations = config.m_rotations;
+
+		LogPolicy& logPolicy = station->logPolicy;
+		logPolicy.m_adaptive = config.m_logAdaptive;
+		logPolicy.m_idleRate = config.m_logIdleRate;
+		logPolicy.m_positionThreshold = config.m_logPosThreshold;
+		logPolicy.m_angleThreshold = config.m_logAngleThreshold;
+
+		// the first device logs to data.hdata, the others to data.<n>.hdata
+		string fileName = (i == 0) ? "data.hdata" : "data." + to_string(i) + ".hdata";
+		if (!dataLogger.open(fileName, config.m_participantID, config.getHash()))
+			return -1;
 	}
 
     //--------------------------------------------------------------------------
     // OPENGL - WINDOW DISPLAY
     //--------------------------------------------------------------------------
 
-    // initialize GLUT
-    glutInit(&argc, argv);
+    // without a window the haptics, the logger and the trials run on their own
+    if (!headless)
+    {
+        // initialize GLUT
+        glutInit(&argc, argv);
 
-    // retrieve  resolution of computer display and position window accordingly
-    screenW = glutGet(GLUT_SCREEN_WIDTH);
-    screenH = glutGet(GLUT_SCREEN_HEIGHT);
-    windowW = (int)(0.8 * screenH);
-    windowH = (int)(0.5 * screenH);
-    windowPosY = (screenH - windowH) / 2;
-    windowPosX = windowPosY; 
+        // retrieve  resolution of computer display and position window accordingly
+        screenW = glutGet(GLUT_SCREEN_WIDTH);
+        screenH = glutGet(GLUT_SCREEN_HEIGHT);
+        windowW = (int)(0.8 * screenH);
+        windowH = (int)(0.5 * screenH);
+        windowPosY = (screenH - windowH) / 2;
+        windowPosX = windowPosY; 
 
-    // initialize the OpenGL GLUT window
-    glutInitWindowPosition(windowPosX, windowPosY);
-    glutInitWindowSize(windowW, windowH);
+        // initialize the OpenGL GLUT window
+        glutInitWindowPosition(windowPosX, windowPosY);
+        glutInitWindowSize(windowW, windowH);
 
-    if (stereoMode == C_STEREO_ACTIVE)
-        glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE | GLUT_STEREO);
-    else
-        glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
+        if (stereoMode == C_STEREO_ACTIVE)
+            glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE | GLUT_STEREO);
+        else
+            glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
 
-    // create display context and initialize GLEW library
-    glutCreateWindow(argv[0]);
+        // create display context and initialize GLEW library
+        glutCreateWindow(argv[0]);
 
 #ifdef GLEW_VERSION
-    // initialize GLEW
-    glewInit();
+        // initialize GLEW
+        glewInit();
 #endif
 
-    // setup GLUT options
-    glutDisplayFunc(updateGraphics);
-    glutKeyboardFunc(keySelect);
-	glutMouseFunc(mouseClick);
-	glutMotionFunc(mouseMove);
-    glutReshapeFunc(resizeWindow);
-    glutSetWindowTitle("Dice Game");
-	createMenu();
-
-    // set fullscreen mode
-    if (fullscreen)
-    {
-        glutFullScreen();
+        // swap on the vertical retrace or pace the frames to a target rate
+        framePacer.m_vsync = config.m_frameVsync;
+        framePacer.m_rate = config.m_frameRate;
+        framePacer.start();
+
+        // how far ahead the poses are extrapolated
+        posePredictor.m_enabled = (config.m_prediction != "OFF");
+        posePredictor.m_horizon = (config.m_prediction == "AUTO") ? -1.0 : config.m_predictionHorizon;
+
+        // setup GLUT options
+        glutDisplayFunc(updateGraphics);
+        glutKeyboardFunc(keySelect);
+        glutMouseFunc(mouseClick);
+        glutMotionFunc(mouseMove);
+        glutReshapeFunc(resizeWindow);
+        glutSetWindowTitle("Dice Game");
+        createMenu();
+
+        // set fullscreen mode
+        if (fullscreen)
+        {
+            glutFullScreen();
+        }
     }
 
 
@@ -337,12 +486,15 @@ int main(int argc, char* argv[])
     // create a new world.
     world = new cWorld();
 
+    // create the world that is drawn; the objects are copied into it below
+    displayWorld = new cWorld();
+
     // set the background color of the environment
-    world->m_backgroundColor.setBlack();
+    displayWorld->m_backgroundColor.setBlack();
 
     // create a camera and insert it into the virtual world
-    camera = new cCamera(world);
-    world->addChild(camera);
+    camera = new cCamera(displayWorld);
+    displayWorld->addChild(camera);
 
 	// define a basis in spherical coordinates for the camera
 	camera->setSphericalReferences(cVector3d(0, 0, 0),    // origin
@@ -367,10 +519,10 @@ int main(int argc, char* argv[])
     camera->setMirrorVertical(mirroredDisplay);
 
     // create a directional light source
-    light = new cDirectionalLight(world);
+    light = new cDirectionalLight(displayWorld);
 
     // insert light source inside world
-    world->addChild(light);
+    displayWorld->addChild(light);
 
     // enable light source
     light->setEnabled(true);
@@ -383,59 +535,122 @@ int main(int argc, char* argv[])
     // HAPTIC DEVICE
     //--------------------------------------------------------------------------
 
-    // create a haptic device handler
-    handler = new cHapticDeviceHandler();
+    if (config.m_traceMode == "REPLAY")
+    {
+        // feed a recorded session back through the loop
+        if (!traceReader.open(config.m_traceFile) || traceReader.getNumFrames() == 0)
+        {
+            cerr << "Error: Input trace " << config.m_traceFile << " could not be read!" << endl;
+            return -1;
+        }
+        traceDevice = TraceDevicePtr(new TraceDevice(&traceReader));
+        traceDevice->m_realTime = config.m_traceRealTime;
+        stations[0]->device = traceDevice;
+    }
+    else if (config.m_device == "SIMULATED")
+    {
+        // play a scripted session instead of reading the hardware, on every station
+        for (size_t i = 0; i < stations.size(); i++)
+        {
+            SimulatedDevicePtr simulatedDevice(new SimulatedDevice(config.m_simRate));
+            simulatedDevice->m_realTime = config.m_simRealTime;
+            simulatedDevices.push_back(simulatedDevice);
+            stations[i]->device = simulatedDevice;
+        }
+    }
+    else
+    {
+        // create a haptic device handler
+        handler = new cHapticDeviceHandler();
+        if (handler->getNumDevices() < stations.size())
+        {
+            cerr << "Error: " << stations.size() << " haptic devices are configured, but only "
+                << handler->getNumDevices() << " are connected!" << endl;
+            return -1;
+        }
+
+        // get a handle to the first haptic devices
+        for (size_t i = 0; i < stations.size(); i++)
+            handler->getDevice(stations[i]->device, i);
+    }
+
+    // record everything the loop reads from the device
+    if (config.m_traceMode == "RECORD")
+    {
+        cHapticDeviceInfo specifications = stations[0]->device->getSpecifications();
+        InputTraceDevice device;
+        device.workspaceRadius = specifications.m_workspaceRadius;
+        device.maxLinearForce = specifications.m_maxLinearForce;
+        device.maxLinearStiffness = specifications.m_maxLinearStiffness;
+        device.maxLinearDamping = specifications.m_maxLinearDamping;
+        if (!traceWriter.open(config.m_traceFile, device))
+            return -1;
+
+        traceDevice = TraceDevicePtr(new TraceDevice(stations[0]->device, &traceWriter));
+        stations[0]->device = traceDevice;
+    }
 
-    // get a handle to the first haptic device
-    handler->getDevice(hapticDevice, 0);
+	// define the radius of the tools (spheres)
+	double toolRadius = 0.1;
 
-    // open a connection to haptic device
-    hapticDevice->open();
+	// the materials have to stay stable on the weakest device
+	double maxStiffness = 0.0;
 
-    // calibrate device (if necessary)
-    hapticDevice->calibrate();
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		cGenericHapticDevicePtr hapticDevice = stations[i]->device;
 
-    // retrieve information about the current haptic device
-    cHapticDeviceInfo info = hapticDevice->getSpecifications();
+		// open a connection to haptic device
+		hapticDevice->open();
 
-    // if the device has a gripper, enable the gripper to simulate a user switch
-    hapticDevice->setEnableGripperUserSwitch(true);
+		// calibrate device (if necessary)
+		hapticDevice->calibrate();
 
-	// create a tool (cursor) and insert into the world
-	tool = new cToolCursor(world);
-	world->addChild(tool);
+		// retrieve information about the current haptic device
+		cHapticDeviceInfo info = hapticDevice->getSpecifications();
 
-	// connect the haptic device to the virtual tool
-	tool->setHapticDevice(hapticDevice);
+		// if the device has a gripper, enable the gripper to simulate a user switch
+		hapticDevice->setEnableGripperUserSwitch(true);
 
-	// define the radius of the tool (sphere)
-	double toolRadius = 0.1;
-	tool->setRadius(toolRadius);
+		// create a tool (cursor) and insert into the world; the other
+		// stations collide in worlds of their own (see HapticStation.h)
+		cWorld* stationWorld = (i == 0) ? world : new cWorld();
+		cToolCursor* tool = new cToolCursor(stationWorld);
+		stationWorld->addChild(tool);
+		stations[i]->tool = tool;
+		stations[i]->world = stationWorld;
 
-	// map the physical workspace of the haptic device to a larger virtual workspace.
-	tool->setWorkspaceRadius(1.2);
+		// connect the haptic device to the virtual tool
+		tool->setHapticDevice(hapticDevice);
 
-	// enable if objects in the scene are going to rotate of translate
-	// or possibly collide against the tool. If the environment
-	// is entirely static, you can set this parameter to "false"
-	tool->enableDynamicObjects(true);
+		// define the radius of the tool (sphere)
+		tool->setRadius(toolRadius);
 
-	// haptic forces are enabled only if small forces are first sent to the device;
-	// this mode avoids the force spike that occurs when the application starts when
-	// the tool is located inside an object for instance.
-	tool->setWaitForSmallForce(true);
+		// map the physical workspace of the haptic device to a larger virtual workspace.
+		tool->setWorkspaceRadius(1.2);
 
-	// start the haptic tool
-	tool->start();
+		// enable if objects in the scene are going to rotate of translate
+		// or possibly collide against the tool. If the environment
+		// is entirely static, you can set this parameter to "false"
+		tool->enableDynamicObjects(true);
 
-	// read the scale factor between the physical workspace of the haptic
-	// device and the virtual workspace defined for the tool
-	double workspaceScaleFactor = tool->getWorkspaceScaleFactor();
+		// haptic forces are enabled only if small forces are first sent to the device;
+		// this mode avoids the force spike that occurs when the application starts when
+		// the tool is located inside an object for instance.
+		tool->setWaitForSmallForce(true);
 
-	// stiffness properties
-	double maxLinearForce = info.m_maxLinearForce;
-	double maxLinearDamping = info.m_maxLinearDamping;
-	double maxStiffness = info.m_maxLinearStiffness / workspaceScaleFactor;
+		// start the haptic tool
+		tool->start();
+
+		// read the scale factor between the physical workspace of the haptic
+		// device and the virtual workspace defined for the tool
+		double workspaceScaleFactor = tool->getWorkspaceScaleFactor();
+
+		// stiffness properties
+		double stiffness = info.m_maxLinearStiffness / workspaceScaleFactor;
+		if (i == 0 || stiffness < maxStiffness)
+			maxStiffness = stiffness;
+	}
 
 	//--------------------------------------------------------------------------
 	// OBJECTS
@@ -471,12 +686,22 @@ int main(int argc, char* argv[])
 	// Load object files
 	/*actDice->loadFromFile("../../models/dice.obj");
 	refDice->loadFromFile("../../models/dice.obj");*/
-	actDice->loadFromFile("C:/Users/nm911876/Desktop/Projects/DiceGame/models/dice.obj");
-	refDice->loadFromFile("C:/Users/nm911876/Desktop/Projects/DiceGame/models/dice.obj");
+	string diceModel = "C:/Users/nm911876/Desktop/Projects/DiceGame/models/dice.obj";
+	if (!actDice->loadFromFile(diceModel))
+	{
+		// other machines (build servers) run from bin/<platform> of a checkout
+		diceModel = "../../models/dice.obj";
+		actDice->loadFromFile(diceModel);
+	}
+	refDice->loadFromFile(diceModel);
 
 	// Radius of the bounding sphere for the actual dice (manipulated by the user)
 	radii = cSub(actDice->getBoundaryMax(), actDice->getBoundaryMin()).length() * scale * 0.5;
 
+	// box around the actual dice, for the analytic collision proxy
+	cVector3d diceSize = cMul(scale, cSub(actDice->getBoundaryMax(), actDice->getBoundaryMin()));
+	cVector3d diceCenter = cMul(0.5 * scale, cAdd(actDice->getBoundaryMax(), actDice->getBoundaryMin()));
+
 	// create the bounding sphere
 	cCreateSphere(boundingSphere, radii);
 	// create the virtual button
@@ -503,11 +728,100 @@ int main(int argc, char* argv[])
 	refDice->scale(scale);
 
 	// create collision detector
-	actDice->createAABBCollisionDetector(toolRadius);
-	virtualButton->createAABBCollisionDetector(toolRadius);
+	if (config.m_collision == "MESH")
+	{
+		actDice->createAABBCollisionDetector(toolRadius);
+		virtualButton->createAABBCollisionDetector(toolRadius);
+	}
 
 	boundingSphere->setEnabled(false);
 
+	// the graphics thread draws copies that share the meshes, so it never
+	// reads a transform while a haptic thread writes it; the button gets
+	// its own material to light up while it is pressed
+	displayRefDice = refDice->copy(false, false, false, false);
+	displayActDice = actDice->copy(false, false, false, false);
+	displayBoundingSphere = boundingSphere->copy(false, false, false, false);
+	displayButton = virtualButton->copy(true, false, false, false);
+	displayWorld->addChild(displayRefDice);
+	displayWorld->addChild(displayActDice);
+	displayActDice->addChild(displayBoundingSphere);
+	displayWorld->addChild(displayButton);
+	displayRefDice->setLocalPos(refDice->getLocalPos());
+	displayBoundingSphere->setLocalPos(0.0, 0.0, 0.0);
+	displayBoundingSphere->setEnabled(false);
+	displayButton->setLocalPos(virtualButton->getLocalPos());
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		cShapeSphere* cursor = new cShapeSphere(toolRadius);
+		displayWorld->addChild(cursor);
+		displayTools.push_back(cursor);
+	}
+	publishDice();
+
+	// the worlds of the other stations get their own copies of the actual
+	// dice and the button, sharing the meshes; the haptic loops keep the
+	// copies of the dice at the pose published by the first station
+	vector<cGenericObject*> collisionDice(1, actDice);
+	vector<cGenericObject*> collisionButtons(1, virtualButton);
+	stations[0]->dice = actDice;
+	for (size_t i = 1; i < stations.size(); i++)
+	{
+		cMultiMesh* dice = actDice->copy(false, false, false, false);
+		cMesh* button = virtualButton->copy(false, false, false, false);
+		dice->m_name = "actDice";
+		button->m_name = "virtualButton";
+		stations[i]->world->addChild(dice);
+		stations[i]->world->addChild(button);
+		dice->setLocalPos(actDice->getLocalPos());
+		button->setLocalPos(virtualButton->getLocalPos());
+		if (config.m_collision == "MESH")
+		{
+			dice->createAABBCollisionDetector(toolRadius);
+			button->createAABBCollisionDetector(toolRadius);
+		}
+		stations[i]->world->computeGlobalPositions(true);
+		stations[i]->dice = dice;
+		collisionDice.push_back(dice);
+		collisionButtons.push_back(button);
+	}
+
+	// the dice is a cube and the button a sphere: instead of traversing
+	// their triangles, the proxy of the tool collides with an invisible box
+	// and sphere (constant cost per tick).  They hang off the objects they
+	// stand for, so they move with them and the contact checks of the
+	// haptic loop find the same objects as with the meshes.
+	if (config.m_collision == "ANALYTIC")
+	{
+		for (size_t i = 0; i < collisionDice.size(); i++)
+		{
+			cShapeBox* diceProxy = new cShapeBox(diceSize(0), diceSize(1), diceSize(2));
+			collisionDice[i]->addChild(diceProxy);
+			diceProxy->setLocalPos(diceCenter);
+			diceProxy->setMaterial(matMembrane);
+			diceProxy->setShowEnabled(false);
+
+			cShapeSphere* buttonProxy = new cShapeSphere(radii / 2);
+			buttonProxy->m_name = "virtualButton";
+			collisionButtons[i]->addChild(buttonProxy);
+			buttonProxy->setMaterial(matButton);
+			buttonProxy->setShowEnabled(false);
+		}
+	}
+	cout << "Collision: " << (config.m_collision == "ANALYTIC" ? "analytic box and sphere" : "AABB trees of the meshes") << endl;
+
+	// script the simulated devices against the scene, in device coordinates;
+	// they all play the same session and compete for the dice
+	for (size_t i = 0; i < simulatedDevices.size(); i++)
+	{
+		double workspaceScaleFactor = stations[i]->tool->getWorkspaceScaleFactor();
+		simulatedDevices[i]->planSession(cMul(1.0 / workspaceScaleFactor, actDice->getLocalPos()),
+			cMul(1.0 / workspaceScaleFactor, virtualButton->getLocalPos()), config.m_rotations);
+	}
+	if (!simulatedDevices.empty())
+		cout << "Simulated device: " << simulatedDevices[0]->getDuration() << " s session at " << simulatedDevices[0]->m_rate
+			<< " Hz on " << simulatedDevices.size() << " station(s)" << endl;
+
 
     //--------------------------------------------------------------------------
     // WIDGETS
@@ -521,26 +835,88 @@ int main(int argc, char* argv[])
     labelHapticRate->m_fontColor.setWhite();
     camera->m_frontLayer->addChild(labelHapticRate);
 
+    // create a label to display the latency of the haptic loop
+    labelHapticLatency = new cLabel(font);
+    labelHapticLatency->m_fontColor.setWhite();
+    camera->m_frontLayer->addChild(labelHapticLatency);
+
+    // create a label to display the current trial
+    labelTrial = new cLabel(font);
+    labelTrial->m_fontColor.setWhite();
+    camera->m_frontLayer->addChild(labelTrial);
+
+    // create a label to display the frame rate and times
+    labelFrames = new cLabel(font);
+    labelFrames->m_fontColor.setWhite();
+    camera->m_frontLayer->addChild(labelFrames);
+
+    // create a label to display the motion-to-photon latency
+    labelMotionToPhoton = new cLabel(font);
+    labelMotionToPhoton->m_fontColor.setWhite();
+    camera->m_frontLayer->addChild(labelMotionToPhoton);
+
+    // from now on only the subtrees that moved get their global frames
+    // recomputed by the first station; its tool moves on every tick
+    sceneUpdater.setScene(world);
+    sceneUpdater.setAlwaysDirty(stations[0]->tool);
+
     //--------------------------------------------------------------------------
     // START SIMULATION
     //--------------------------------------------------------------------------
 
-    // create a thread which starts the main haptics rendering loop
-    cThread* hapticsThread = new cThread();
+    // pacing of the haptic loops; each thread is pinned (to consecutive
+    // cores) and prioritized by its loop itself
+    for (size_t i = 0; i < stations.size(); i++)
+    {
+        HapticScheduler& hapticScheduler = stations[i]->scheduler;
+        hapticScheduler.m_rate = config.m_hapticRate;
+        hapticScheduler.m_waitMode = config.m_hapticWait == "SLEEP" ? HapticScheduler::SLEEP :
+            config.m_hapticWait == "SPIN" ? HapticScheduler::SPIN : HapticScheduler::HYBRID;
+        hapticScheduler.m_spinTime = config.m_hapticSpinTime;
+        hapticScheduler.m_cpu = config.m_hapticCpu >= 0 ? config.m_hapticCpu + (int)i : -1;
+        hapticScheduler.m_priority = config.m_hapticPriority;
+    }
+
+    // a replay is paced by the trace (or not at all with FAST)
+    if (traceDevice && traceDevice->isReplaying())
+        stations[0]->scheduler.m_rate = 0.0;
+
+    // update state
+    simulationRunning = true;
+
+	// one haptic thread and one flushing thread per station
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		stations[i]->finished = false;
+
+		// create a thread which starts the main haptics rendering loop
+		cThread* hapticsThread = new cThread();
+		hapticsThread->start(updateHaptics, CTHREAD_PRIORITY_HAPTICS, stations[i]);
+
+		// create a thread for writing the data
+		cThread* flushingThread = new cThread();
+		flushingThread->start(flushData, CTHREAD_PRIORITY_GRAPHICS, stations[i]);
+	}
 
-	// create threads for data logging and writing
 	//cThread* dataThread = new cThread();
-	cThread* flushingThread = new cThread();
+	cThread* controllerThread = new cThread();
+	cThread* traceThread = new cThread();
 
-	hapticsThread->start(updateHaptics, CTHREAD_PRIORITY_HAPTICS);
 	//dataThread->start(logData, CTHREAD_PRIORITY_HAPTICS);
-	flushingThread->start(flushData, CTHREAD_PRIORITY_GRAPHICS);
+	controllerThread->start(controlTrials, CTHREAD_PRIORITY_GRAPHICS);
+	if (config.m_traceMode == "RECORD")
+		traceThread->start(writeTrace, CTHREAD_PRIORITY_GRAPHICS);
 
     // setup callback when application exits
     atexit(close);
 
+    if (headless)
+    {
+        return (runHeadless());
+    }
+
     // start the main graphics rendering loop
-    glutTimerFunc(50, graphicsTimer, 0);
+    glutTimerFunc(framePacer.getDelayMs(), graphicsTimer, 0);
     glutMainLoop();
 
     // exit
@@ -568,11 +944,11 @@ void keySelect(unsigned char key, int x, int y)
 
 	if (key == 32)
 	{
-		// Orientation of the reference dice
+		// Orientation of the reference dice (the first station turns it)
 		double angleX = rand() % 360;
 		double angleY = rand() % 360;
 		double angleZ = rand() % 360;
-		refDice->rotateExtrinsicEulerAnglesDeg(angleX, angleY, angleZ, C_EULER_ORDER_XYZ);
+		refDiceRequest.store(cVector3d(angleX, angleY, angleZ));
 	}
 }
 
@@ -608,8 +984,8 @@ void mouseMove(int x, int y)
 		camera->setSphericalAzimuthDeg(azimuthDeg);
 		camera->setSphericalPolarDeg(polarDeg);
 
-		// line up tool with camera
-		tool->setLocalRot(camera->getLocalRot());
+		// line up tools with camera (the haptic threads apply it to their tools)
+		toolRotation.store(camera->getLocalRot());
 	}
 }
 
@@ -617,65 +993,181 @@ void mouseMove(int x, int y)
 
 void close(void)
 {
+    // close() runs again from atexit() after an explicit call
+    static bool closed = false;
+    if (closed)
+        return;
+    closed = true;
+
     // stop the simulation
     simulationRunning = false;
 
     // wait for graphics and haptics loops to terminate
-    while (!simulationFinished) { cSleepMs(100); }
+    for (size_t i = 0; i < stations.size(); i++)
+    {
+        while (!stations[i]->finished) { cSleepMs(100); }
+    }
 
-    // close haptic device
-    hapticDevice->close();
+    // close haptic devices
+    for (size_t i = 0; i < stations.size(); i++)
+    {
+        stations[i]->device->close();
+    }
 
-	Sleep(100);
+	// stop the trial controller
+	trialController.stop();
+	while (!trialController.isFinished()) { cSleepMs(10); }
+
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		// let the flushing thread write the remaining samples
+		DataLogger& dataLogger = stations[i]->dataLogger;
+		dataLogger.stop();
+		while (!dataLogger.isFinished()) { cSleepMs(10); }
 
-	// close data file
-	dataBuffer.safe_flush(dataFile);
-	Sleep(100);
-	fclose(dataFile);
+		// close data file
+		dataLogger.close();
+	}
+
+	// write the rest of the input trace
+	if (config.m_traceMode == "RECORD")
+	{
+		traceWriter.stop();
+		while (!traceWriter.isFinished()) { cSleepMs(10); }
+		traceWriter.close();
+	}
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		if (stations.size() > 1)
+			cout << "Station " << i << ":" << endl;
+		stations[i]->dataLogger.printStatistics();
+		stations[i]->logPolicy.printStatistics();
+		stations[i]->profiler.printStatistics(cout);
+		stations[i]->scheduler.printStatistics(cout);
+		if (i < simulatedDevices.size())
+			cout << "Simulated device: " << simulatedDevices[i]->getTime() << " of " << simulatedDevices[i]->getDuration()
+				<< " s played, largest force " << simulatedDevices[i]->getMaxForce() << " N" << endl;
+	}
+	trialController.printStatistics();
+	orientationMatch.printStatistics();
+	framePacer.printStatistics(cout);
+	posePredictor.printStatistics(cout);
+	if (stations.size() > 1)
+		cout << "Dice: grabbed " << diceArbiter.getGrabs() << " times by the participants, " << diceArbiter.getConflicts()
+			<< " grabs refused while another station held it, " << diceArbiter.getInternalGrabs()
+			<< " internal grabs (trial start, reference dice, reset)" << endl;
+	if (config.m_traceMode == "RECORD")
+	{
+		cout << "Input trace: " << traceWriter.getFrames() << " frames recorded" << endl;
+		if (traceWriter.getDroppedFrames() > 0)
+			cerr << "Warning: " << traceWriter.getDroppedFrames() << " frames of the input trace were dropped, it will not replay the session!" << endl;
+	}
+	if (traceDevice && traceDevice->isReplaying())
+	{
+		cout << "Input trace: " << traceDevice->getTicks() << " of " << traceReader.getNumFrames() << " frames replayed" << endl;
+		if (traceDevice->getMatchMismatches() > 0)
+			cerr << "Warning: the match with the reference completed trials on " << traceDevice->getMatchMismatches()
+				<< " ticks otherwise than in the recording!" << endl;
+	}
+	cout << "Scene update: " << sceneUpdater.getUpdatedSubtrees() << " subtrees recomputed, "
+		<< sceneUpdater.getSkippedSubtrees() << " skipped" << endl;
 }
 
 //------------------------------------------------------------------------------
 
 void graphicsTimer(int data)
 {
-    if (simulationRunning)
+    // redraw once the next frame is due; with vsync and no target rate the
+    // swap of the frame waits for the retrace
+    int delay = framePacer.getDelayMs();
+    if (simulationRunning && delay == 0)
     {
         glutPostRedisplay();
     }
 
-    glutTimerFunc(50, graphicsTimer, 0);
+    glutTimerFunc(delay, graphicsTimer, 0);
 }
 
 //------------------------------------------------------------------------------
 
 void updateGraphics(void)
 {
+    framePacer.beginFrame();
+
+    /////////////////////////////////////////////////////////////////////
+    // UPDATE SCENE
+    /////////////////////////////////////////////////////////////////////
+
+    // copy the latest complete state of the haptic threads into the display
+    // world, extrapolated to the time the frame is displayed
+    posePredictor.beginFrame(framePacer.getFrameStart(), framePacer.getPresentEstimate());
+
+    DiceSnapshot dice = diceSnapshot.load();
+    posePredictor.predict(dice.time, dice.actDiceLinVel, dice.actDiceAngVel, dice.actDicePos, dice.actDiceRot);
+    displayActDice->setLocalPos(dice.actDicePos);
+    displayActDice->setLocalRot(dice.actDiceRot);
+    displayRefDice->setLocalRot(dice.refDiceRot);
+
+    for (size_t i = 0; i < stations.size(); i++)
+    {
+        ToolSnapshot tool = stations[i]->toolSnapshot.load();
+        posePredictor.predict(tool.time, tool.linVel, tool.angVel, tool.pos, tool.rot);
+        displayTools[i]->setLocalPos(tool.pos);
+        displayTools[i]->setLocalRot(tool.rot);
+    }
+
+    // the button lights up while it is pressed
+    TrialSnapshot trial = trialSnapshot.load();
+    if (trial.buttonPressed)
+        displayButton->m_material->setRedCrimson();
+    else
+        displayButton->m_material->setBlueCadet();
+
+
     /////////////////////////////////////////////////////////////////////
     // UPDATE WIDGETS
     /////////////////////////////////////////////////////////////////////
 
     // display haptic rate data
-    labelHapticRate->setText(cStr(frequencyCounter.getFrequency(), 0) + " Hz");
+    string rates;
+    for (size_t i = 0; i < stations.size(); i++)
+        rates += (i > 0 ? " / " : "") + cStr(stations[i]->frequencyCounter.getFrequency(), 0);
+    labelHapticRate->setText(rates + " Hz, " + stations[0]->scheduler.getSummary());
 
     // update position of label
     labelHapticRate->setLocalPos((int)(0.5 * (windowW - labelHapticRate->getWidth())), 15);
 
+    // display the latency of the haptic loop (the histograms are read lock-free)
+    labelHapticLatency->setText(stations[0]->profiler.getSummary());
+    labelHapticLatency->setLocalPos((int)(0.5 * (windowW - labelHapticLatency->getWidth())), 40);
+
+    // display the current trial
+    labelTrial->setText("Trial " + cStr(cMin(trial.trial + 1, config.m_numSubExp)) + " of " + cStr(config.m_numSubExp));
+    labelTrial->setLocalPos((int)(0.5 * (windowW - labelTrial->getWidth())), 65);
+
+    // display the frame rate and the times of the previous frames
+    labelFrames->setText(framePacer.getSummary());
+    labelFrames->setLocalPos((int)(0.5 * (windowW - labelFrames->getWidth())), 90);
+
+    // display the estimated motion-to-photon latency
+    labelMotionToPhoton->setText(posePredictor.getSummary());
+    labelMotionToPhoton->setLocalPos((int)(0.5 * (windowW - labelMotionToPhoton->getWidth())), 115);
+
 
     /////////////////////////////////////////////////////////////////////
     // RENDER SCENE
     /////////////////////////////////////////////////////////////////////
 
     // update shadow maps (if any)
-    world->updateShadowMaps(false, mirroredDisplay);
+    displayWorld->updateShadowMaps(false, mirroredDisplay);
 
     // render world
     camera->renderView(windowW, windowH);
 
-    // swap buffers
+    // swap buffers; the GPU finishes the frame on its own (see FramePacer.h)
+    framePacer.beforeSwap();
     glutSwapBuffers();
-
-    // wait until all GL commands are completed
-    glFinish();
+    framePacer.endFrame();
 
     // check for any OpenGL errors
     GLenum err;
@@ -685,31 +1177,95 @@ void updateGraphics(void)
 
 //------------------------------------------------------------------------------
 
-void updateHaptics(void)
+void updateHaptics(void* arg)
 {
+	HapticStation* station = (HapticStation*)arg;
+	cGenericHapticDevicePtr hapticDevice = station->device;
+	cToolCursor* tool = station->tool;
+	HapticScheduler& hapticScheduler = station->scheduler;
+	HapticProfiler& hapticProfiler = station->profiler;
+
+	// the first station runs the trials, the others only report button contacts
+	bool runsTrials = (station->index == 0);
+
 	cMode state = IDLE;
 	cVirtualMode vState = vmIDLE;
 	cTransform tool_T_object;
+	cGenericObject* selectedObject = NULL;
+	DiceTarget heldDice;	// other stations: where this station moves the dice
 
 	HapticData tmpData;
+	tmpData.time = 0.0;
+	tmpData.matchAngle = C_PI;	// nothing matched before the first tick
 
-	// update state
-	simulationRunning = true;
-	simulationFinished = false;
+	// versions of the requests of the graphics thread already applied
+	unsigned int seenToolRotation = 0;
+	unsigned int seenRefDiceRequest = 0;
+	unsigned int seenResetRequest = 0;
+
+	// versions of the dice already applied: targets of the holder (first
+	// station), poses of the first station (the others)
+	unsigned int seenDiceTarget = 0;
+	unsigned int seenDice = 0;
+
+	hapticScheduler.start();
 
 	while (simulationRunning)
 	{
+		// wait for the next tick of the schedule (returns at once when free-running)
+		tmpData.tick = hapticScheduler.wait();
+
+		hapticProfiler.beginLoop();
+
 		// update frequency counter
-		frequencyCounter.signal(1);
+		station->frequencyCounter.signal(1);
 
-		// compute global reference frames for each object
-		world->computeGlobalPositions(true);
+		// the requests of the graphics thread come from the trace in a replay
+		bool replaying = traceDevice && traceDevice->isReplaying();
+
+		// line up the tool with the camera after the mouse moved it
+		bool rotated = !replaying && toolRotation.version() != seenToolRotation;
+		cMatrix3d rotation;
+		if (rotated)
+		{
+			seenToolRotation = toolRotation.version();
+			rotation = toolRotation.load();
+		}
+		if (traceDevice)
+			rotated = traceDevice->traceToolRotation(rotated, rotation);
+		if (rotated)
+			tool->setLocalRot(rotation);
+
+		// compute global reference frames for the objects that moved; the
+		// first station moves the dice where its holder asked first, every
+		// other station moves its copy of the dice to the published pose
+		if (runsTrials)
+		{
+			applyDiceTarget(seenDiceTarget);
+			sceneUpdater.update();
+		}
+		else
+		{
+			cWorld* stationWorld = station->world;
+			if (diceSnapshot.version() != seenDice)
+			{
+				seenDice = diceSnapshot.version();
+				DiceSnapshot dice = diceSnapshot.load();
+				station->dice->setLocalPos(dice.actDicePos);
+				station->dice->setLocalRot(dice.actDiceRot);
+				station->dice->computeGlobalPositions(true, stationWorld->getGlobalPos(), stationWorld->getGlobalRot());
+			}
+			tool->computeGlobalPositions(true, stationWorld->getGlobalPos(), stationWorld->getGlobalRot());
+		}
+		hapticProfiler.mark(HapticProfiler::GLOBAL_POSITIONS);
 
 		// update position and orientation of tool
 		tool->updateFromDevice();
+		hapticProfiler.mark(HapticProfiler::UPDATE_FROM_DEVICE);
 
 		// compute interaction forces
 		tool->computeInteractionForces();
+		hapticProfiler.mark(HapticProfiler::INTERACTION_FORCES);
 
 		
 		//-------------------------------------------------------------
@@ -739,8 +1295,12 @@ void updateHaptics(void)
 
 				// get object from contact event
 				selectedObject = collisionEvent->m_object->getParent();
-				if (selectedObject-> m_name == "actDice")
+				if (selectedObject-> m_name == "actDice" && diceArbiter.tryGrab(station->index))
 				{
+					// another station may have let the dice go since the start of the tick
+					if (runsTrials && applyDiceTarget(seenDiceTarget))
+						selectedObject->computeGlobalPositions(true, world->getGlobalPos(), world->getGlobalRot());
+
 					// get transformation from object
 					cTransform world_T_object = selectedObject->getGlobalTransform();
 
@@ -772,8 +1332,27 @@ void updateHaptics(void)
 			parent_T_world.invert();
 			cTransform parent_T_object = parent_T_world * world_T_object;
 
-			// assign new local transformation to object
-			selectedObject->setLocalTransform(parent_T_object);
+			// the dice moves rigidly with the device
+			cVector3d angVel = tool->getDeviceGlobalAngVel();
+			cVector3d lever = cSub(world_T_object.getLocalPos(), world_T_tool.getLocalPos());
+			cVector3d linVel = cAdd(tool->getDeviceGlobalLinVel(), cCross(angVel, lever));
+
+			if (runsTrials)
+			{
+				// assign new local transformation to object
+				selectedObject->setLocalTransform(parent_T_object);
+				sceneUpdater.markDirty(selectedObject);
+				publishDice(linVel, angVel);
+			}
+			else
+			{
+				// the first station moves the dice, and the copy follows
+				heldDice.pos = parent_T_object.getLocalPos();
+				heldDice.rot = parent_T_object.getLocalRot();
+				heldDice.linVel = linVel;
+				heldDice.angVel = angVel;
+				diceTarget.store(heldDice);
+			}
 
 			// set zero forces when manipulating objects
 			tool->setDeviceGlobalForce(0.0, 0.0, 0.0);
@@ -786,6 +1365,19 @@ void updateHaptics(void)
 		//
 		else
 		{
+			// the dice stops where it was let go; then let the other stations grab it
+			if (state == SELECTION)
+			{
+				if (runsTrials)
+					publishDice();
+				else
+				{
+					heldDice.linVel.zero();
+					heldDice.angVel.zero();
+					diceTarget.store(heldDice);
+				}
+				diceArbiter.release(station->index);
+			}
 			state = IDLE;
 		}
 
@@ -793,54 +1385,216 @@ void updateHaptics(void)
 		// Start/stop experiment
 		//-------------------------------------------------------------
 		//cGenericObject* contactObject;
-		if (tool->m_hapticPoint->getNumCollisionEvents() > 0 && vState == vmIDLE)
+
+		// publish the contacts of this tool for the first station (stored
+		// only when they change, so the other cores mostly read)
+		bool touchingNothing = (tool->m_hapticPoint->getNumCollisionEvents() == 0);
+		bool touchingButton = !touchingNothing && tool->m_hapticPoint->getCollisionEvent(0)->m_object->m_name == "virtualButton";
+		if (touchingButton != station->touchingButton.load(memory_order_relaxed))
+			station->touchingButton.store(touchingButton, memory_order_release);
+		if (touchingNothing != station->touchingNothing.load(memory_order_relaxed))
+			station->touchingNothing.store(touchingNothing, memory_order_release);
+
+		// the button is pressed by any tool and released once no tool touches
+		// anything; the other stations never leave vmIDLE
+		bool buttonPressed = false;
+		bool buttonReleased = true;
+		if (runsTrials)
 		{
-			if (tool->m_hapticPoint->getCollisionEvent(0)->m_object->m_name == "virtualButton" && vState == vmIDLE)
+			for (size_t i = 0; i < stations.size(); i++)
 			{
-				timer.stop();
-				vState = vmCONTACT;
+				buttonPressed = buttonPressed || stations[i]->touchingButton.load(memory_order_acquire);
+				buttonReleased = buttonReleased && stations[i]->touchingNothing.load(memory_order_acquire);
 			}
 		}
-		else if (tool->m_hapticPoint->getNumCollisionEvents() == 0 && vState == vmCONTACT)
+
+		// a dice left matched with the reference completes the trial as well
+		// (angle of the previous tick, see below); the first station holds
+		// the dice here only while it moves it.  The hold is timed on the
+		// clock of the trace, so a replay completes the trial on the same tick.
+		double tickTime = traceDevice ? traceDevice->getTickTime() : latencyNow() / 1e9;
+		bool matched = runsTrials && vState == vmIDLE &&
+			orientationMatch.update(tmpData.matchAngle, diceArbiter.getHolder() == GrabArbiter::NOBODY, tickTime);
+		if (traceDevice)
+			traceDevice->checkMatch(matched);
+
+		if (buttonPressed && vState == vmIDLE)
+		{
+			timer.stop();
+			vState = vmCONTACT;
+		}
+		else if (matched && indSubExp < config.m_numSubExp)
+		{
+			timer.stop();
+			TrialEvent event;
+			event.trial = indSubExp;
+			event.completionTime = tmpData.time;
+			event.timestamp = latencyNow();
+			event.refDiceRotation = refDice->getLocalRot();
+			if (trialController.post(event))
+				vState = vmWAIT;
+		}
+		else if (buttonReleased && vState == vmCONTACT)
 		{
 			if (indSubExp < config.m_numSubExp)
 			{
-				refDice->rotateAboutLocalAxisRad(cVector3d(config.m_rotations[indSubExp][0], config.m_rotations[indSubExp][1], config.m_rotations[indSubExp][2]), config.m_rotations[indSubExp][3]);
+				// hand the trial over to the controller thread, which prints
+				// and computes the next target
+				TrialEvent event;
+				event.trial = indSubExp;
+				event.completionTime = tmpData.time;	// the timer stopped on contact, in an earlier tick
+				event.timestamp = latencyNow();
+				event.refDiceRotation = refDice->getLocalRot();
+				if (trialController.post(event))
+					vState = vmWAIT;
+			}
+		}
+
+		// start the next trial once its target has been published; the world
+		// is reset only while no other station holds the dice.  A replay
+		// starts the trial on the recorded tick, however long the controller
+		// takes.  The dice is grabbed only then, not on every tick of the wait.
+		TrialTarget target;
+		bool started = false;
+		if (vState == vmWAIT && (replaying ? traceDevice->traceTrialStart(false) : trialController.isReady()) &&
+			diceArbiter.tryGrab(station->index, true))
+		{
+			// the first station writes the dice from here on; bring it up to date first
+			applyDiceTarget(seenDiceTarget);
+
+			if (replaying)
+			{
+				while (simulationRunning && !(started = trialController.poll(target)))
+					cSleepMs(1);
+			}
+			else
+			{
+				started = trialController.poll(target);
+				if (traceDevice)
+					traceDevice->traceTrialStart(started);
+			}
+
+			if (started)
+			{
+				refDice->setLocalRot(target.refDiceRotation);
+				sceneUpdater.markDirty(refDice);
 				resetWorld();
 
-				// time measurement
-				cout << "Elapsed time: " << timer.getCurrentTimeSeconds() << endl;
 				timer.reset();
-				Sleep(10);
 				timer.start();
+				orientationMatch.reset();
 
 				// set the virtual button state to idle
 				vState = vmIDLE;
-				++indSubExp;
+				indSubExp = target.trial;
+			}
+
+			if (state != SELECTION)
+				diceArbiter.release(station->index);
+		}
+
+		// turn the reference dice as asked with the space key
+		cVector3d angles;
+		bool turn = replaying ? traceDevice->traceRefDiceTurn(false, angles) : refDiceRequest.version() != seenRefDiceRequest;
+		if (runsTrials && turn && diceArbiter.tryGrab(station->index, true))
+		{
+			applyDiceTarget(seenDiceTarget);
+			if (!replaying)
+			{
+				seenRefDiceRequest = refDiceRequest.version();
+				angles = refDiceRequest.load();
+				if (traceDevice)
+					traceDevice->traceRefDiceTurn(true, angles);
 			}
+			refDice->rotateExtrinsicEulerAnglesDeg(angles(0), angles(1), angles(2), C_EULER_ORDER_XYZ);
+			sceneUpdater.markDirty(refDice);
+			publishDice();
+
+			if (state != SELECTION)
+				diceArbiter.release(station->index);
+		}
+
+		// reset the world as asked from the menu, not while another station holds the dice
+		bool reset = replaying ? traceDevice->traceReset(false) : resetRequest.version() != seenResetRequest;
+		if (runsTrials && reset && diceArbiter.tryGrab(station->index, true))
+		{
+			applyDiceTarget(seenDiceTarget);
+			if (!replaying)
+			{
+				seenResetRequest = resetRequest.version();
+				if (traceDevice)
+					traceDevice->traceReset(true);
+			}
+			resetWorld();
+
+			if (state != SELECTION)
+				diceArbiter.release(station->index);
+		}
+
+		// publish the tool and the trial for the graphics thread
+		ToolSnapshot toolState;
+		toolState.pos = tool->m_hapticPoint->getGlobalPosProxy();
+		toolState.rot = tool->getDeviceGlobalRot();
+		toolState.time = latencyNow();
+		// the proxy follows the device unless it is held on a surface
+		toolState.linVel = (state == SELECTION || touchingNothing) ? tool->getDeviceGlobalLinVel() : cVector3d(0, 0, 0);
+		toolState.angVel = tool->getDeviceGlobalAngVel();
+		toolState.selecting = (state == SELECTION);
+		toolState.touchingButton = touchingButton;
+		station->toolSnapshot.store(toolState);
+		if (runsTrials)
+		{
+			TrialSnapshot trialState;
+			trialState.trial = indSubExp;
+			trialState.buttonPressed = (vState == vmCONTACT);
+			trialSnapshot.store(trialState);
 		}
 		
+		hapticProfiler.mark(HapticProfiler::STATE_MACHINE);
+
 		// send forces to haptic device
 		tool->applyToDevice();
+		hapticProfiler.mark(HapticProfiler::APPLY_TO_DEVICE);
+
+		// the dice as published by their holder, never half moved, and their
+		// distance to the target (logged, and used for completion next tick)
+		DiceSnapshot dice = diceSnapshot.load();
+		tmpData.matchAngle = orientationMatch.angle(dice.actDiceRot, dice.refDiceRot);
+		hapticProfiler.mark(HapticProfiler::MATCH_SCORE);
 
 		// Log data temporaryly to tmpData struct
 		hapticDevice->getPosition(tmpData.devicePos);
 		hapticDevice->getLinearVelocity(tmpData.deviceVel);
 		hapticDevice->getRotation(tmpData.deviceOrientation);
-		tmpData.actDicePos = actDice->getLocalPos();
-		tmpData.actDiceOrientation = actDice->getLocalRot();
-		tmpData.refDiceOrientation = refDice->getLocalRot();
-		tmpData.time = timer.getCurrentTimeSeconds();
-
-		dataBuffer.push_back(tmpData);
+		tmpData.actDicePos = dice.actDicePos;
+		tmpData.actDiceOrientation = dice.actDiceRot;
+		tmpData.refDiceOrientation = dice.refDiceRot;
+		tmpData.time = traceDevice ? traceDevice->traceTrialTime(timer.getCurrentTimeSeconds()) : timer.getCurrentTimeSeconds();
+		tmpData.trial = indSubExp;
+
+		// full rate while manipulating, decimated or change-driven while idle
+		bool contact = runsTrials ? (vState == vmCONTACT) : touchingButton;
+		tmpData.flags = station->logPolicy.select(tmpData, state == SELECTION, contact);
+		if (tmpData.flags != 0)
+			station->dataLogger.log(tmpData);
+		hapticProfiler.mark(HapticProfiler::LOG_PUSH);
+
+		// record the inputs of this tick, or move the replay on to the next one
+		if (traceDevice)
+			traceDevice->endTick();
+
+		hapticProfiler.endLoop();
 	}
 
+	hapticScheduler.stop();
+
 	// disable forces
 	hapticDevice->setForceAndTorqueAndGripperForce(cVector3d(0.0, 0.0, 0.0), cVector3d(0.0, 0.0, 0.0), 0.0);
+	diceArbiter.release(station->index);
 
 	// update state
 	simulationRunning = false;
-	simulationFinished = true;
+	station->finished = true;
 }
 
 //------------------------------------------------------------------------------
@@ -897,29 +1651,94 @@ void processMenuEvents(int option)
 		camera->setMirrorVertical(mirroredDisplay);
 		break;
 	case BOUNDING_SPHERE:
-		boundingSphere->setEnabled(!(boundingSphere->getEnabled()));
+		displayBoundingSphere->setEnabled(!(displayBoundingSphere->getEnabled()));
 		break;
 	case SEPARATOR:
 		break;
 	case RESET_WORLD:
-		resetWorld();
+		// the first station resets the world once no other station holds the dice
+		resetRequest.store(true);
 	}
 }
 
 //------------------------------------------------------------------------------
 
-void flushData(void)
+// true once every simulated device has played its script, false without any
+bool simulatedDevicesFinished(void)
 {
-	while (simulationRunning)
+	for (size_t i = 0; i < simulatedDevices.size(); i++)
 	{
-		dataBuffer.safe_flush(dataFile);
+		if (!simulatedDevices[i]->isFinished())
+			return false;
 	}
+	return !simulatedDevices.empty();
+}
 
-	dataBuffer.safe_flush(dataFile);
+int runHeadless(void)
+{
+	cPrecisionClock session;
+	session.start();
 
-	// update state
-	simulationRunning = false;
-	simulationFinished = true;
+	if (traceDevice && traceDevice->isReplaying())
+	{
+		// a replay ends with its trace, wherever the recorded session stopped
+		while (!traceDevice->isFinished())
+			cSleepMs(10);
+	}
+	else
+	{
+		// the trial controller counts the releases of the virtual button; a
+		// script that misses the button or the dice ends with its devices
+		while (trialController.getCompletedTrials() < (unsigned int)config.m_numSubExp && !simulatedDevicesFinished())
+			cSleepMs(10);
+
+		// let the devices play out their scripts
+		while (!simulatedDevices.empty() && !simulatedDevicesFinished())
+			cSleepMs(10);
+	}
+	cSleepMs(100);
+
+	double duration = session.getCurrentTimeSeconds();
+	cout << "Headless session: " << trialController.getCompletedTrials() << " trial(s) in " << duration << " s, ";
+	for (size_t i = 0; i < stations.size(); i++)
+		cout << (i > 0 ? " / " : "") << (unsigned long long)(stations[i]->scheduler.getTicks() / duration);
+	cout << " ticks/s" << endl;
+
+	int result = 0;
+	if ((!traceDevice || !traceDevice->isReplaying()) && trialController.getCompletedTrials() < (unsigned int)config.m_numSubExp)
+	{
+		cerr << "Error: only " << trialController.getCompletedTrials() << " of " << config.m_numSubExp << " trials were completed!" << endl;
+		result = 1;
+	}
+	if (traceDevice && traceDevice->isReplaying() && traceDevice->getMatchMismatches() > 0)
+		result = 1;
+
+	close();
+	return result;
+}
+
+//------------------------------------------------------------------------------
+
+void writeTrace(void)
+{
+	// writes the frames in blocks and returns once close() has stopped the writer
+	traceWriter.run();
+}
+
+//------------------------------------------------------------------------------
+
+void controlTrials(void)
+{
+	// sleeps until a trial is completed and returns once close() has stopped the controller
+	trialController.run();
+}
+
+//------------------------------------------------------------------------------
+
+void flushData(void* arg)
+{
+	// sleeps until blocks are ready and returns once close() has stopped the logger
+	((HapticStation*)arg)->dataLogger.run();
 }
 
 //------------------------------------------------------------------------------
@@ -928,6 +1747,41 @@ void resetWorld(void)
 {
 	actDice->setLocalPos(0.0, 1.0, 0.0);
 	actDice->setLocalRot(cMatrix3d(1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0));
+	sceneUpdater.markDirty(actDice);
+	publishDice();
+}
+
+//------------------------------------------------------------------------------
+
+void publishDice(const cVector3d& linVel, const cVector3d& angVel)
+{
+	DiceSnapshot dice;
+	dice.actDicePos = actDice->getLocalPos();
+	dice.actDiceRot = actDice->getLocalRot();
+	dice.refDiceRot = refDice->getLocalRot();
+	dice.time = latencyNow();
+	dice.actDiceLinVel = linVel;
+	dice.actDiceAngVel = angVel;
+	diceSnapshot.store(dice);
+}
+
+//------------------------------------------------------------------------------
+
+bool applyDiceTarget(unsigned int& seenVersion)
+{
+	// the holder stores its last target before it releases the dice, so
+	// once the first station holds it no newer target can follow
+	unsigned int version = diceTarget.version();
+	if (version == seenVersion)
+		return false;
+	seenVersion = version;
+
+	DiceTarget target = diceTarget.load();
+	actDice->setLocalPos(target.pos);
+	actDice->setLocalRot(target.rot);
+	sceneUpdater.markDirty(actDice);
+	publishDice(target.linVel, target.angVel);
+	return true;
 }
 
 //------------------------------------------------------------------------------
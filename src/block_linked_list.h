@@ -12,8 +12,19 @@
 #ifndef _BLOCK_LINKED_LIST_H_
 #define _BLOCK_LINKED_LIST_H_
 
+#include <atomic>
+#include <cstdio>
+#include <new>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 // This is a custom data structure that I used for buffering data on
-// its way out to disk.  It is not a random access data structure;
+// its way out to disk.  It is not a general-purpose container;
 // it just buffers up objects of type T and flushes them out to disk.
 //
 // If you're using flusher and writer threads, the general protocol
@@ -37,6 +48,24 @@
 // Note that in this mode, the "flusher" thread should _not_ also put
 // data into the array; i.e. the writer thread "owns" the push_back
 // function.
+//
+// Beside the linked list, a table of block pointers is kept so that
+// operator[] takes constant time.  Indices are relative to the current
+// head; after a flush the remaining elements move down.
+//
+// The writer and the flusher share only two counters, both absolute
+// element counts: sealed_index(), the elements in blocks the writer
+// has left for good (published with release semantics once the next
+// block is linked), and begin_index(), the elements flushed so far
+// (published by the flusher).  safe_flush() reads exactly the sealed
+// blocks, and the writer trims the entries of flushed blocks from its
+// block table itself, so the flusher owns head and the writer owns the
+// tail, the table and operator[].  The read-only ranges (see const_range)
+// cover sealed blocks only and are taken on the flusher's side, so they
+// can be read while the writer pushes.  A node pool is not thread-safe:
+// with two threads, let the nodes come from the heap.  In DiceGame the
+// list is owned by the flushing thread alone; the haptic thread hands its
+// samples over through spsc_ring (see spsc_ring.h).
 
 
 // The node type for the linked list
@@ -49,31 +78,272 @@ public:
 	block_linked_list_node() {
 		data = new T[chunk_size];
 		next = 0;
+		owns_data = true;
+	}
+	// Wraps chunk_size T's owned by someone else (e.g. a pool)
+	block_linked_list_node(T* storage) {
+		data = storage;
+		next = 0;
+		owns_data = false;
 	}
 	~block_linked_list_node() {
-		delete[] data;
+		if (owns_data) delete[] data;
+	}
+
+private:
+	bool owns_data;
+};
+
+// A pool of preallocated nodes.  All the storage is allocated up front
+// (optionally on huge pages, when the OS grants them) and nodes that the
+// list releases go back on a free list instead of to the heap, so a list
+// that stays within the pool size does no allocation at all.  If the
+// pool runs dry it falls back to the heap and counts the overflow.
+//
+// The pool is not thread-safe; it belongs to the thread that owns the
+// list(s) drawing from it.
+template <class T, size_t chunk_size> class block_linked_list_pool {
+public:
+
+	block_linked_list_pool(size_t num_nodes, bool use_huge_pages = false) {
+
+		m_capacity = num_nodes;
+		m_in_use = m_high_water_mark = m_overflow = 0;
+
+		slab = allocate_slab(num_nodes * chunk_size * sizeof(T), use_huge_pages);
+
+		T* storage = static_cast<T*>(slab);
+		for (size_t i = 0; i < num_nodes * chunk_size; i++) {
+			new (storage + i) T();
+		}
+
+		free_nodes.reserve(num_nodes);
+		for (size_t i = 0; i < num_nodes; i++) {
+			all_nodes.push_back(new block_linked_list_node<T, chunk_size>(storage + i * chunk_size));
+		}
+		free_nodes = all_nodes;
+	}
+
+	~block_linked_list_pool() {
+
+		for (size_t i = 0; i < all_nodes.size(); i++) {
+			delete all_nodes[i];
+		}
+
+		T* storage = static_cast<T*>(slab);
+		for (size_t i = 0; i < m_capacity * chunk_size; i++) {
+			storage[i].~T();
+		}
+
+		free_slab();
+	}
+
+	// Returns an empty node, from the free list if possible
+	block_linked_list_node<T, chunk_size>* acquire() {
+
+		block_linked_list_node<T, chunk_size>* node;
+
+		if (free_nodes.empty()) {
+			node = new block_linked_list_node<T, chunk_size>;
+			m_overflow++;
+		}
+		else {
+			node = free_nodes.back();
+			free_nodes.pop_back();
+		}
+
+		node->next = 0;
+		m_in_use++;
+		if (m_in_use > m_high_water_mark) m_high_water_mark = m_in_use;
+
+		return node;
 	}
+
+	// Gives a node back; nodes that did not come from the slab are deleted
+	void release(block_linked_list_node<T, chunk_size>* node) {
+
+		m_in_use--;
+
+		T* storage = static_cast<T*>(slab);
+		if (node->data >= storage && node->data < storage + m_capacity * chunk_size) {
+			free_nodes.push_back(node);
+		}
+		else {
+			delete node;
+		}
+	}
+
+	// Number of nodes currently handed out
+	size_t nodes_in_use() const { return m_in_use; }
+
+	// Largest number of nodes that were handed out at the same time
+	size_t high_water_mark() const { return m_high_water_mark; }
+
+	// Number of preallocated nodes
+	size_t capacity() const { return m_capacity; }
+
+	// Number of nodes that had to be allocated on the heap
+	size_t overflow_allocations() const { return m_overflow; }
+
+	// True if the slab is backed by huge (large) pages
+	bool huge_pages() const { return m_huge_pages; }
+
+private:
+
+	void* slab;
+	size_t slab_bytes;
+	bool m_huge_pages;
+
+	std::vector<block_linked_list_node<T, chunk_size>*> all_nodes;
+	std::vector<block_linked_list_node<T, chunk_size>*> free_nodes;
+
+	size_t m_capacity;
+	size_t m_in_use;
+	size_t m_high_water_mark;
+	size_t m_overflow;
+
+	void* allocate_slab(size_t bytes, bool use_huge_pages) {
+
+		m_huge_pages = false;
+		slab_bytes = bytes;
+		void* p = 0;
+
+		if (use_huge_pages) {
+#if defined(_WIN32)
+			// needs the "Lock pages in memory" privilege; silently falls back otherwise
+			SIZE_T large = GetLargePageMinimum();
+			if (large > 0) {
+				slab_bytes = (bytes + large - 1) / large * large;
+				p = VirtualAlloc(0, slab_bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			}
+#elif defined(MAP_HUGETLB)
+			const size_t large = 2 * 1024 * 1024;
+			slab_bytes = (bytes + large - 1) / large * large;
+			p = mmap(0, slab_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p == MAP_FAILED) p = 0;
+#endif
+			if (p != 0) {
+				m_huge_pages = true;
+				return p;
+			}
+		}
+
+		slab_bytes = bytes;
+		p = ::operator new(bytes);
+		return p;
+	}
+
+	void free_slab() {
+
+		if (!m_huge_pages) {
+			::operator delete(slab);
+			return;
+		}
+#if defined(_WIN32)
+		VirtualFree(slab, 0, MEM_RELEASE);
+#else
+		munmap(slab, slab_bytes);
+#endif
+	}
+
+	block_linked_list_pool(const block_linked_list_pool&);
+	block_linked_list_pool& operator=(const block_linked_list_pool&);
 };
 
 // The data structure itself
 template <class T, size_t chunk_size> class block_linked_list {
 public:
 
-	// The head of the list
-	block_linked_list_node<T, chunk_size>* head;
+	// A read-only view of count consecutive sealed elements of the list
+	// (see sealed_index()).  Nothing is copied, and since push_back() never
+	// writes a sealed block again, the view stays valid while the writer
+	// keeps pushing, until the flusher flushes its blocks.
+	class const_range {
+	public:
+
+		class const_iterator {
+		public:
+			const_iterator(const block_linked_list_node<T, chunk_size>* n, size_t o, size_t i) : node(n), offset(o), index(i) {}
+			const T& operator*() const { return node->data[offset]; }
+			const T* operator->() const { return node->data + offset; }
+			const_iterator& operator++() {
+				index++;
+				if (++offset == chunk_size) { node = node->next; offset = 0; }
+				return *this;
+			}
+			bool operator==(const const_iterator& other) const { return index == other.index; }
+			bool operator!=(const const_iterator& other) const { return index != other.index; }
+		private:
+			const block_linked_list_node<T, chunk_size>* node;
+			size_t offset;
+			size_t index;
+		};
+
+		const_range() : first_node(0), first_offset(0), first(0), count(0) {}
+		const_range(const block_linked_list_node<T, chunk_size>* node, size_t offset, size_t first_index, size_t num_elements)
+			: first_node(node), first_offset(offset), first(first_index), count(num_elements) {}
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		// Absolute index of the first element (see begin_index())
+		size_t begin_index() const { return first; }
+
+		// Element i of the range; walks the blocks before it
+		const T& operator[](size_t i) const {
+			size_t element = first_offset + i;
+			const block_linked_list_node<T, chunk_size>* node = first_node;
+			for (size_t b = element / chunk_size; b > 0; b--) node = node->next;
+			return node->data[element % chunk_size];
+		}
 
-	// The number of T's in the list
-	size_t total_count;
+		const T& front() const { return first_node->data[first_offset]; }
+		const T& back() const { return (*this)[count - 1]; }
+
+		const_iterator begin() const { return const_iterator(first_node, first_offset, 0); }
+		const_iterator end() const { return const_iterator(0, 0, count); }
+
+		// Calls f(const T* data, size_t n) once per contiguous piece of the
+		// range; the fastest way to run over a long range
+		template <class F> void for_each_block(F f) const {
+			const block_linked_list_node<T, chunk_size>* node = first_node;
+			size_t offset = first_offset;
+			size_t done = 0;
+			while (done < count) {
+				size_t n = chunk_size - offset;
+				if (n > count - done) n = count - done;
+				f(node->data + offset, n);
+				done += n;
+				node = node->next;
+				offset = 0;
+			}
+		}
 
-	// A pointer to the current (tail) block
+	private:
+		const block_linked_list_node<T, chunk_size>* first_node;
+		size_t first_offset;
+		size_t first;
+		size_t count;
+	};
+
+	// The head of the list (flusher)
+	block_linked_list_node<T, chunk_size>* head;
+
+	// A pointer to the current (tail) block (writer)
 	block_linked_list_node<T, chunk_size>* current_node;
 
-	// The number of T's in the current (tail) block
+	// The number of T's in the current (tail) block (writer)
 	size_t current_count;
 
-	block_linked_list() {
-		current_node = head = new block_linked_list_node<T, chunk_size>;
-		current_count = total_count = 0;
+	// If a pool is given, nodes are drawn from and returned to it instead
+	// of the heap.  The pool must outlive the list.
+	block_linked_list(block_linked_list_pool<T, chunk_size>* node_pool = 0) {
+		pool = node_pool;
+		head = current_node = 0;
+		end_count = 0;
+		flushed_count = 0;
+		sealed_count = 0;
+		clear();
 	};
 
 	// Note that since the list itself has no concept of the file
@@ -82,36 +352,44 @@ public:
 		kill();
 	}
 
-	// Deletes everything in the array and leaves an empty (but valid) head node
+	// Deletes everything in the array and leaves an empty (but valid) head
+	// node.  Not while another thread uses the list.
 	void clear() {
 		kill();
-		current_node = head = new block_linked_list_node<T, chunk_size>;
-		current_count = total_count = 0;
+		current_node = head = new_node();
+		blocks.push_back(head);
+		table_origin = end_count;
+		current_count = 0;
+		flushed_count.store(end_count, std::memory_order_relaxed);
+		sealed_count.store(end_count, std::memory_order_relaxed);
 	}
 
 	// Adds an element to the end of the array.  Returns the total
 	// number of elements in the array.
 	int push_back(const T& in) {
 
-		total_count++;
-
 		// If we just filled up a chunk
 		if (current_count == chunk_size) {
-			block_linked_list_node<T, chunk_size>* tmp = new block_linked_list_node<T, chunk_size>;
+			block_linked_list_node<T, chunk_size>* tmp = new_node();
 			current_count = 0;
 			current_node->next = tmp;
 			current_node = tmp;
+			append_block(tmp);
+
+			// the full block is linked and never written again: the flusher may take it
+			sealed_count.store(end_count, std::memory_order_release);
 		}
 
 		current_node->data[current_count] = in;
 		current_count++;
+		end_count++;
 
-		return total_count;
+		return size();
 	}
 
 	// Flushes the whole array to the specified file, and clears the 
 	// contents of the array (unless the optional second parameter is
-	// explicitly set to 0).
+	// explicitly set to 0).  Only once the writer is done.
 	//
 	// Returns 0 for success or an ferror() code for failure.
 	int flush(FILE* f, int clear_array = 1) {
@@ -145,25 +423,24 @@ public:
 		return 0;
 	} // flush(FILE* f)
 
-	// Flushes the whole array _except_ for the current (tail) node.
-	// Deletes all the blocks it encounters if clear_array is 1.
-	// Note that this may leave a list with two nodes if a new node
-	// was added _during_ the operation.
+	// Flushes the sealed blocks, i.e. the whole array _except_ for the
+	// current (tail) node, and deletes them if clear_array is 1.  Safe
+	// while the writer keeps pushing.
 	int safe_flush(FILE* f, int clear_array = 1) {
 
+		size_t first = begin_index();
+		size_t sealed = sealed_index();
 		block_linked_list_node<T, chunk_size>* cur = head;
-		block_linked_list_node<T, chunk_size>* initial_tail = current_node;
 
 		int error = 0;
 
-		while (cur != initial_tail) {
+		for (size_t i = first; i < sealed; i += chunk_size) {
 
 			// Dump the blocks out to disk
 
 			// Always a whole block, since we never touch the current node
 			int count = chunk_size;
 			int result = fwrite(cur->data, sizeof(T), count, f);
-			total_count -= chunk_size;
 
 			if (result != count) {
 				error = ferror(f);
@@ -175,7 +452,7 @@ public:
 
 		if (error) return error;
 
-		if (clear_array) delete_until(initial_tail);
+		if (clear_array) delete_until(cur, sealed);
 
 		fflush(f);
 
@@ -183,72 +460,186 @@ public:
 
 	}
 
-	// Used for randomly accessing the array.  This is O(N); this
-	// data structure is not well-suited for random access.  Returns
-	// 0 if index is invalid.
-	T* operator[] (int index) {
+	// Same as flush(), but hands each block to sink(const T* data, size_t count)
+	// instead of writing it to a file.  sink returns 0 for success or an
+	// error code, which is passed on.
+	template <class Sink> int flush_to(Sink& sink, int clear_array = 1) {
 
-		if (index >= total_count || index < 0) {
-			return 0;
+		block_linked_list_node<T, chunk_size>* cur = head;
+
+		while (cur != 0) {
+
+			size_t count = (cur == current_node ? current_count : chunk_size);
+			int error = sink(cur->data, count);
+			if (error) return error;
+
+			cur = cur->next;
 		}
 
+		if (clear_array) clear();
+
+		return 0;
+	}
+
+	// Same as safe_flush(), but hands each sealed block to sink (see flush_to)
+	template <class Sink> int safe_flush_to(Sink& sink, int clear_array = 1) {
+
+		size_t first = begin_index();
+		size_t sealed = sealed_index();
 		block_linked_list_node<T, chunk_size>* cur = head;
 
-		// Which block number is it in
-		int block_num = index % total_count;
+		for (size_t i = first; i < sealed; i += chunk_size) {
+
+			int error = sink(cur->data, chunk_size);
+			if (error) return error;
 
-		// Advance that many blocks forward
-		for (int i = 0; i<block_num; i++) {
 			cur = cur->next;
 		}
 
-		int offset = index % chunk_size;
+		if (clear_array) delete_until(cur, sealed);
+
+		return 0;
+	}
+
+	// Used for randomly accessing the array (writer).  This is O(1),
+	// through the block table.  Returns 0 if index is invalid.  With a
+	// flusher thread, only the elements of the tail block are safe from it.
+	T* operator[] (size_t index) {
+
+		if (index >= (size_t)size()) {
+			return 0;
+		}
+
+		size_t element = begin_index() + index - table_origin;
+		return blocks[element / chunk_size]->data + element % chunk_size;
+	}
+
+	const T* operator[] (size_t index) const {
+
+		if (index >= (size_t)size()) {
+			return 0;
+		}
 
-		return cur->data[offset];
+		size_t element = begin_index() + index - table_origin;
+		return blocks[element / chunk_size]->data + element % chunk_size;
 	}
 
-	int size() { return total_count; }
+	// Sealed elements [first, first + count), by absolute index, clamped to
+	// the sealed part of the list (flusher).  Taking a range walks the
+	// blocks from the head; iterating it takes constant time per element.
+	const_range range(size_t first, size_t count) const {
+		size_t begin = begin_index();
+		size_t sealed = sealed_index();
+		if (first < begin) first = begin;
+		if (first > sealed) first = sealed;
+		if (count > sealed - first) count = sealed - first;
+
+		const block_linked_list_node<T, chunk_size>* node = head;
+		for (size_t b = (first - begin) / chunk_size; b > 0; b--) node = node->next;
+		return const_range(node, (first - begin) % chunk_size, first, count);
+	}
+
+	// The last n sealed elements (or all of them, if there are fewer)
+	const_range last(size_t n) const {
+		size_t sealed = sealed_index();
+		return range(n < sealed ? sealed - n : 0, n);
+	}
+
+	// All sealed elements from the absolute index to the end, e.g. the
+	// samples of the current trial from its first one; the part that has
+	// already been flushed is left out
+	const_range since(size_t absolute_index) const {
+		return range(absolute_index, sealed_index());
+	}
+
+	// Number of elements in the list (writer)
+	int size() const { return (int)(end_count - begin_index()); }
+
+	// Absolute index of the first element in the list, i.e. the number of
+	// elements flushed (or cleared) so far
+	size_t begin_index() const { return flushed_count.load(std::memory_order_acquire); }
+
+	// Absolute index one past the last element of the sealed blocks
+	size_t sealed_index() const { return sealed_count.load(std::memory_order_acquire); }
+
+	// Absolute index one past the last element (writer), e.g. to remember
+	// where a trial starts
+	size_t end_index() const { return end_count; }
+
+	// The pool the nodes are drawn from (0 if they come from the heap)
+	block_linked_list_pool<T, chunk_size>* node_pool() { return pool; }
 
 private:
 
+	block_linked_list_pool<T, chunk_size>* pool;
+
+	// Pointers to the nodes in list order (writer); blocks[0] starts at
+	// the absolute index table_origin, and may already have been flushed
+	std::vector<block_linked_list_node<T, chunk_size>*> blocks;
+	size_t table_origin;
+
+	// Absolute index one past the last element (writer)
+	size_t end_count;
+
+	// Published by the flusher and by the writer, see above
+	std::atomic<size_t> flushed_count;
+	std::atomic<size_t> sealed_count;
+
+	block_linked_list_node<T, chunk_size>* new_node() {
+		if (pool) return pool->acquire();
+		return new block_linked_list_node<T, chunk_size>;
+	}
+
+	void delete_node(block_linked_list_node<T, chunk_size>* node) {
+		if (pool) pool->release(node);
+		else delete node;
+	}
+
+	// Adds a block to the table, dropping the entries of the blocks the
+	// flusher has deleted since (those pointers are never dereferenced)
+	void append_block(block_linked_list_node<T, chunk_size>* node) {
+
+		size_t flushed = (begin_index() - table_origin) / chunk_size;
+		if (flushed > 0) {
+			blocks.erase(blocks.begin(), blocks.begin() + flushed);
+			table_origin += flushed * chunk_size;
+		}
+
+		blocks.push_back(node);
+	}
+
 	// Deletes everything in the array, does not leave a valid head node
 	void kill() {
 
 		// Delete all the nodes; they will delete their own data
 		block_linked_list_node<T, chunk_size>* cur = head;
-		while ((cur != 0) && (cur->next != 0)) {
+		while (cur != 0) {
 			block_linked_list_node<T, chunk_size>* tmp = cur->next;
-			delete cur;
+			delete_node(cur);
 			cur = tmp;
 		}
 
-		current_node = 0;
-		current_count = total_count = 0;
+		head = current_node = 0;
+		current_count = 0;
+		blocks.clear();
 	}
 
-	// Deletes all nodes up to the specified node, which becomes the head node.
-	// If that node is not found, it deletes the whole list and creates a new
-	// head node
-	void delete_until(block_linked_list_node<T, chunk_size>* stop_point) {
+	// Deletes all nodes up to the specified node, which becomes the head
+	// node and starts at the absolute index new_begin (flusher)
+	void delete_until(block_linked_list_node<T, chunk_size>* stop_point, size_t new_begin) {
 
 		block_linked_list_node<T, chunk_size>* cur = head;
 
-		while ((cur != stop_point) && (cur != 0)) {
+		while (cur != stop_point) {
 
 			block_linked_list_node<T, chunk_size>* tmp = cur->next;
-			delete cur;
+			delete_node(cur);
 			cur = tmp;
 
 		}
 
-		// If we found a valid stop point, he becomes the head and we're done
-		if ((cur == stop_point) && (stop_point != 0)) {
-			head = cur;
-			return;
-		}
-
-		// We must not have found a valid stop point... reset the list...
-		clear();
+		head = stop_point;
+		flushed_count.store(new_begin, std::memory_order_release);
 	}
 
 };
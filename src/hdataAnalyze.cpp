@@ -0,0 +1,350 @@
+//==============================================================================
+/*
+
+DiceGame:    hdataAnalyze.cpp
+
+Per-trial analysis of the data.hdata files written by the application
+
+Usage: hdataAnalyze [options] <file.hdata> [<file.hdata> ...]
+       hdataAnalyze [options] --batch <directory>
+
+Options:
+  --batch <directory>   analyze every .hdata file below the directory
+  --threads <n>         number of worker threads (default: one per core)
+  --out <file.csv>      write the table to a file instead of stdout
+  --scaling             run the batch with 1..n threads and print the speedup
+
+For every trial the completion time, the path length of the manipulated
+dice, the final and the integrated orientation error and the peak
+velocity of the haptic device are written as one CSV row, ordered by
+file and trial.  Each file is mapped and read once, front to back; the
+read throughput is reported at the end on stderr.
+
+Files are spread over a work-stealing pool.  A file with a trial index
+is split further into one task per trial, so that a few long sessions
+do not serialize the batch.  Only the summary rows are kept in memory.
+
+*/
+//==============================================================================
+
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "HdataReader.h"
+#include "HdataAnalysis.h"
+#include "WorkStealingPool.h"
+//------------------------------------------------------------------------------
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+//------------------------------------------------------------------------------
+using namespace std;
+//------------------------------------------------------------------------------
+
+// everything known about one file once it has been analyzed
+struct FileResult
+{
+	string fileName;
+	string participantID;
+	vector<TrialMetrics> trials;
+	string error;
+	unsigned long long bytes;
+	atomic<unsigned long long> samples;
+
+	FileResult() : bytes(0), samples(0) {}
+};
+
+//------------------------------------------------------------------------------
+
+// analyze the records of index entry i (or of the whole file if i < 0)
+void analyzeStream(HdataReader& reader, int i, FileResult& result, TrialMetrics* metrics)
+{
+	if (i >= 0)
+		reader.seekTrial(i);
+
+	TrialAnalyzer analyzer(reader.hasTrials());
+	unsigned long long samples = 0;
+
+	const HdataRecord* records;
+	size_t count;
+	while ((count = reader.next(records)) > 0)
+	{
+		analyzer.add(records, count);
+		samples += count;
+	}
+	result.samples += samples;
+
+	if (i >= 0)
+	{
+		if (analyzer.getTrials().size() == 1)
+			*metrics = analyzer.getTrials()[0];
+		else
+			metrics->samples = 0;	// empty or broken chunk
+	}
+	else
+	{
+		result.trials = analyzer.getTrials();
+	}
+}
+
+void analyzeFile(FileResult& result, WorkStealingPool* pool)
+{
+	HdataReader reader;
+	if (!reader.open(result.fileName))
+	{
+		result.error = reader.getError();
+		return;
+	}
+
+	result.participantID = reader.getHeader().m_participantID;
+	result.bytes = reader.getFileSize();
+
+	size_t numTrials = reader.getIndex().size();
+	if (pool == 0 || numTrials < 2)
+	{
+		analyzeStream(reader, -1, result, 0);
+	}
+	else
+	{
+		// one task per trial; each maps the file on its own (the pages are shared)
+		result.trials.resize(numTrials);
+		FileResult* r = &result;
+		for (size_t i = 1; i < numTrials; i++)
+		{
+			pool->submit([r, i]
+			{
+				HdataReader trialReader;
+				if (trialReader.open(r->fileName))
+					analyzeStream(trialReader, (int)i, *r, &r->trials[i]);
+			});
+		}
+		analyzeStream(reader, 0, result, &result.trials[0]);
+	}
+
+	if (reader.getError() != "")
+		result.error = reader.getError();
+}
+
+// recursively collect the .hdata files below directory
+void findFiles(const string& directory, vector<string>& files)
+{
+#if defined(_WIN32)
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		string name = entry.cFileName;
+		if (name == "." || name == "..")
+			continue;
+
+		string path = directory + "\\" + name;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			findFiles(path, files);
+		else if (name.size() > 6 && name.substr(name.size() - 6) == ".hdata")
+			files.push_back(path);
+	} while (FindNextFileA(find, &entry));
+
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == 0)
+		return;
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != 0)
+	{
+		string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		string path = directory + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+			findFiles(path, files);
+		else if (name.size() > 6 && name.substr(name.size() - 6) == ".hdata")
+			files.push_back(path);
+	}
+
+	closedir(dir);
+#endif
+}
+
+// analyze all files; returns the time it took [s]
+double analyzeFiles(vector<FileResult>& results, unsigned int numThreads)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	if (numThreads == 1)
+	{
+		for (size_t i = 0; i < results.size(); i++)
+			analyzeFile(results[i], 0);
+	}
+	else
+	{
+		WorkStealingPool pool(numThreads);
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			FileResult* r = &results[i];
+			WorkStealingPool* p = &pool;
+			pool.submit([r, p] { analyzeFile(*r, p); });
+		}
+		pool.wait();
+	}
+
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void writeResults(FILE* out, const vector<FileResult>& results)
+{
+	fprintf(out, "file,participant,trial,samples,startTime,completionTime,pathLength,"
+		"finalOrientationError,integratedOrientationError,peakVelocity\n");
+
+	for (size_t f = 0; f < results.size(); f++)
+	{
+		for (size_t i = 0; i < results[f].trials.size(); i++)
+		{
+			const TrialMetrics& t = results[f].trials[i];
+			if (t.samples == 0)
+				continue;
+
+			fprintf(out, "%s,%s,%u,%llu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+				results[f].fileName.c_str(), results[f].participantID.c_str(), t.trial, t.samples,
+				t.startTime, t.completionTime, t.pathLength,
+				t.finalOrientationError, t.integratedOrientationError, t.peakVelocity);
+		}
+	}
+}
+
+void printThroughput(const vector<FileResult>& results, double seconds, unsigned int numThreads)
+{
+	unsigned long long bytes = 0, samples = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		bytes += results[i].bytes;
+		samples += results[i].samples;
+	}
+
+	if (seconds > 0.0)
+		cerr << "Read " << results.size() << " file(s), " << bytes / 1e6 << " MB, " << samples << " samples in "
+			<< seconds * 1000.0 << " ms with " << numThreads << " thread(s) ("
+			<< bytes / seconds / 1e9 << " GB/s, " << samples / seconds / 1e6 << " M samples/s)" << endl;
+}
+
+void resetResults(vector<FileResult>& results, const vector<string>& files)
+{
+	results = vector<FileResult>(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+		results[i].fileName = files[i];
+}
+
+int usage(const char* program)
+{
+	cerr << "Usage: " << program << " [--threads <n>] [--out <file.csv>] [--scaling] <file.hdata>... | --batch <directory>" << endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	vector<string> files;
+	string directory, outFile;
+	unsigned int numThreads = 0;
+	bool scaling = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--batch" && i + 1 < argc)
+			directory = argv[++i];
+		else if (arg == "--threads" && i + 1 < argc)
+			numThreads = atoi(argv[++i]);
+		else if (arg == "--out" && i + 1 < argc)
+			outFile = argv[++i];
+		else if (arg == "--scaling")
+			scaling = true;
+		else if (arg.size() > 2 && arg.substr(0, 2) == "--")
+			return usage(argv[0]);
+		else
+			files.push_back(arg);
+	}
+
+	if (directory != "")
+	{
+		findFiles(directory, files);
+		sort(files.begin(), files.end());
+	}
+
+	if (files.empty())
+		return usage(argv[0]);
+
+	if (numThreads == 0)
+		numThreads = max(1u, thread::hardware_concurrency());
+
+	vector<FileResult> results;
+
+	if (scaling)
+	{
+		// the first run only fills the page cache, so that all runs read from memory
+		resetResults(results, files);
+		analyzeFiles(results, numThreads);
+
+		double serial = 0.0;
+		cerr << "threads,seconds,GB/s,speedup" << endl;
+		for (unsigned int n = 1; n <= numThreads; n++)
+		{
+			resetResults(results, files);
+			double seconds = analyzeFiles(results, n);
+			if (n == 1)
+				serial = seconds;
+
+			unsigned long long bytes = 0;
+			for (size_t i = 0; i < results.size(); i++)
+				bytes += results[i].bytes;
+			cerr << n << "," << seconds << "," << bytes / seconds / 1e9 << "," << serial / seconds << endl;
+		}
+	}
+
+	resetResults(results, files);
+	double seconds = analyzeFiles(results, numThreads);
+
+	int failed = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (results[i].error != "")
+		{
+			cerr << "Error: " << results[i].fileName << ": " << results[i].error << endl;
+			failed++;
+		}
+	}
+
+	FILE* out = stdout;
+	if (outFile != "")
+	{
+		out = fopen(outFile.c_str(), "w");
+		if (out == 0)
+		{
+			cerr << "Error: " << outFile << " could not be opened!" << endl;
+			return 1;
+		}
+	}
+
+	writeResults(out, results);
+	if (out != stdout)
+		fclose(out);
+
+	printThroughput(results, seconds, numThreads);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include <atomic>
+#include <cstring>
+
+// Single-writer value that readers copy out whole or not at all.
+//
+// This is the hand-over point for state that one thread changes and
+// others only look at: the haptic threads publish the poses of the scene
+// once per tick and the graphics thread draws the latest complete copy.
+// The writer never waits: store() makes the sequence number odd, copies
+// the value and makes it even again.  A reader copies the value between
+// two reads of the sequence number and retries if the number was odd or
+// has changed in between, so it never sees half of one store and half
+// of another (no torn transforms).  The value is kept as relaxed atomic
+// words, so the compiler cannot move its copy across the fences either.
+//
+// There may be several writers over time (the holder of the dice), as
+// long as only one of them stores at a time and the hand-over between
+// them is itself synchronized.  T must be trivially copyable.
+template <class T> class seqlock {
+
+public:
+
+	seqlock() : sequence(0) {
+		for (size_t i = 0; i < num_words; i++)
+			words[i].store(0, std::memory_order_relaxed);
+	}
+
+	// Writer side.  Never blocks.
+	void store(const T& in) {
+
+		unsigned long long buffer[num_words] = {};
+		memcpy(buffer, &in, sizeof(T));
+
+		unsigned int s = sequence.load(std::memory_order_relaxed);
+		sequence.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < num_words; i++)
+			words[i].store(buffer[i], std::memory_order_relaxed);
+
+		sequence.store(s + 2, std::memory_order_release);
+	}
+
+	// Reader side.  Copies the last complete value.
+	T load() const {
+
+		unsigned long long buffer[num_words];
+		unsigned int s0, s1;
+		do {
+			s0 = sequence.load(std::memory_order_acquire);
+			for (size_t i = 0; i < num_words; i++)
+				buffer[i] = words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s1 = sequence.load(std::memory_order_relaxed);
+		} while ((s0 & 1) != 0 || s0 != s1);
+
+		T out;
+		memcpy(&out, buffer, sizeof(T));
+		return out;
+	}
+
+	// Changes with every store(); a reader that remembers it can skip
+	// the copy while nothing has been stored
+	unsigned int version() const { return sequence.load(std::memory_order_acquire); }
+
+private:
+
+	enum { num_words = (sizeof(T) + sizeof(unsigned long long) - 1) / sizeof(unsigned long long) };
+
+	std::atomic<unsigned int> sequence;
+	std::atomic<unsigned long long> words[num_words];
+
+	seqlock(const seqlock&);
+	seqlock& operator=(const seqlock&);
+};
+
+#endif
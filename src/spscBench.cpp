@@ -0,0 +1,285 @@
+//==============================================================================
+/*
+
+DiceGame:    spscBench.cpp
+
+Latency of the spsc_ring hand-over between the haptic and the flushing
+thread, compared with the block_linked_list it replaced
+
+Usage: spscBench [options]
+
+Options:
+  --samples <n>   number of elements pushed (default: 1000000)
+  --rate <Hz>     push at a fixed rate, like the haptic loop (default: as fast
+                  as possible)
+
+Both structures run under the same harness: a producer thread pushes
+elements the size of a HapticData sample and a consumer thread takes them,
+  - spsc_ring:          a ring of the size the DataLogger uses, try_push()
+                        on the producer, the consumer pops one element at a
+                        time,
+  - block_linked_list:  blocks of the size the DataLogger uses (from the
+                        heap, as before the ring), push_back() on the
+                        producer, the consumer is a flusher that races it
+                        with safe_flush_to() of the sealed blocks.
+Every operation is timed with latencyNow() and recorded in a
+LatencyHistogram:
+  - push:       one try_push() / push_back() call on the producer thread,
+  - consume:    peek(), copy and pop() of one element / one safe_flush_to()
+                that handed over at least one block,
+  - hand-over:  from the start of the push until the consumer has the element,
+  - clock:      two back-to-back latencyNow() calls, the resolution floor of
+                the other rows.
+The mean, p50, p99, p99.9 and max of each are printed in ns, the two
+structures side by side, followed by the number of elements the ring
+dropped because it was full (the list never drops, it allocates).
+Without --rate the producer outruns the consumer and most pushes find the
+ring full; with --rate 1000 the run resembles the haptic loop.  A flusher
+only takes whole blocks, so the hand-over of the list is the time a block
+takes to fill.  The threads spin, so the hand-over is only meaningful on
+two or more cores.
+
+*/
+//==============================================================================
+
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "LatencyHistogram.h"
+#include "block_linked_list.h"
+#include "spsc_ring.h"
+//------------------------------------------------------------------------------
+using namespace std;
+//------------------------------------------------------------------------------
+
+// as large as a HapticData sample, without depending on CHAI3D
+struct Sample
+{
+	unsigned long long pushed;	// latencyNow() before the push
+	double values[40];
+};
+
+enum { RING_SIZE = 4096, BLOCK_SIZE = 1000 };	// as in DataLogger
+
+// the latencies of one structure
+struct Run
+{
+	LatencyHistogram push;
+	LatencyHistogram consume;
+	LatencyHistogram handOver;
+	unsigned long long dropped;
+	double seconds;
+};
+
+//------------------------------------------------------------------------------
+
+// busy waits until sample k is due; at once without a rate
+void pace(unsigned long long start, unsigned long long k, double rate)
+{
+	if (rate <= 0.0)
+		return;
+
+	unsigned long long deadline = start + (unsigned long long)(k * 1e9 / rate);
+	while (latencyNow() < deadline)
+		;
+}
+
+void runRing(Run& run, unsigned long long numSamples, double rate)
+{
+	// too large for the stack
+	spsc_ring<Sample, RING_SIZE>* ring = new spsc_ring<Sample, RING_SIZE>;
+	atomic<bool> producerDone(false);
+
+	thread consumer([&]()
+	{
+		Sample copy;
+		double sum = 0.0;
+
+		for (;;)
+		{
+			unsigned long long t0 = latencyNow();
+			Sample* first;
+			if (ring->peek(first) == 0)
+			{
+				if (producerDone.load(memory_order_acquire) && ring->size() == 0)
+					break;
+				this_thread::yield();
+				continue;
+			}
+			copy = *first;
+			ring->pop(1);
+			unsigned long long t1 = latencyNow();
+
+			run.consume.record(t1 - t0);
+			run.handOver.record(t1 - copy.pushed);
+			sum += copy.values[0];
+		}
+
+		// keep the copies from being optimized away
+		if (sum < 0.0)
+			cout << sum << endl;
+	});
+
+	Sample sample;
+	for (int i = 0; i < 40; i++)
+		sample.values[i] = i;
+
+	unsigned long long start = latencyNow();
+	for (unsigned long long k = 0; k < numSamples; k++)
+	{
+		pace(start, k, rate);
+
+		sample.values[0] = (double)k;
+		sample.pushed = latencyNow();
+		ring->try_push(sample);
+		run.push.record(latencyNow() - sample.pushed);
+	}
+	run.seconds = (latencyNow() - start) / 1e9;
+
+	producerDone.store(true, memory_order_release);
+	consumer.join();
+
+	run.dropped = ring->dropped();
+	delete ring;
+}
+
+void runList(Run& run, unsigned long long numSamples, double rate)
+{
+	// the nodes come from the heap: a pool belongs to a single thread
+	block_linked_list<Sample, BLOCK_SIZE>* list = new block_linked_list<Sample, BLOCK_SIZE>;
+	atomic<bool> producerDone(false);
+
+	thread flusher([&]()
+	{
+		double sum = 0.0;
+		auto sink = [&](const Sample* samples, size_t count)
+		{
+			unsigned long long now = latencyNow();
+			for (size_t i = 0; i < count; i++)
+			{
+				run.handOver.record(now - samples[i].pushed);
+				sum += samples[i].values[0];
+			}
+			return 0;
+		};
+
+		for (;;)
+		{
+			bool done = producerDone.load(memory_order_acquire);
+
+			unsigned long long t0 = latencyNow();
+			if (list->sealed_index() == list->begin_index())
+			{
+				if (done)
+					break;
+				this_thread::yield();
+				continue;
+			}
+			list->safe_flush_to(sink);
+			run.consume.record(latencyNow() - t0);
+		}
+
+		// the writer is done for good: take the tail block as well
+		unsigned long long t0 = latencyNow();
+		list->flush_to(sink);
+		run.consume.record(latencyNow() - t0);
+
+		if (sum < 0.0)
+			cout << sum << endl;
+	});
+
+	Sample sample;
+	for (int i = 0; i < 40; i++)
+		sample.values[i] = i;
+
+	unsigned long long start = latencyNow();
+	for (unsigned long long k = 0; k < numSamples; k++)
+	{
+		pace(start, k, rate);
+
+		sample.values[0] = (double)k;
+		sample.pushed = latencyNow();
+		list->push_back(sample);
+		run.push.record(latencyNow() - sample.pushed);
+	}
+	run.seconds = (latencyNow() - start) / 1e9;
+
+	producerDone.store(true, memory_order_release);
+	flusher.join();
+
+	run.dropped = 0;
+	delete list;
+}
+
+void printRow(const char* name, const LatencyHistogram& ring, const LatencyHistogram& list)
+{
+	char line[256];
+	sprintf(line, "  %-10s %10.1f %10llu %10llu %10llu %10llu   | %10.1f %10llu %10llu %10llu %10llu", name,
+		ring.getMean(), ring.getPercentile(50.0), ring.getPercentile(99.0), ring.getPercentile(99.9), ring.getMax(),
+		list.getMean(), list.getPercentile(50.0), list.getPercentile(99.0), list.getPercentile(99.9), list.getMax());
+	cout << line << endl;
+}
+
+int usage(const char* program)
+{
+	cerr << "Usage: " << program << " [--samples <n>] [--rate <Hz>]" << endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned long long numSamples = 1000000;
+	double rate = 0.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--samples" && i + 1 < argc)
+			numSamples = strtoull(argv[++i], NULL, 10);
+		else if (arg == "--rate" && i + 1 < argc)
+			rate = atof(argv[++i]);
+		else
+			return usage(argv[0]);
+	}
+
+	if (numSamples == 0 || rate < 0.0)
+		return usage(argv[0]);
+
+	// the histograms are too large for the stack
+	Run* ring = new Run;
+	Run* list = new Run;
+	LatencyHistogram* clock = new LatencyHistogram;
+
+	for (int i = 0; i < 100000; i++)
+	{
+		unsigned long long t0 = latencyNow();
+		clock->record(latencyNow() - t0);
+	}
+
+	runRing(*ring, numSamples, rate);
+	runList(*list, numSamples, rate);
+
+	char line[256];
+	cout << numSamples << " samples of " << sizeof(Sample) << " bytes in " << ring->seconds << " s (ring of "
+		<< RING_SIZE << ") and " << list->seconds << " s (blocks of " << BLOCK_SIZE << ")" << endl;
+	cout << "Latency [ns]:" << endl;
+	sprintf(line, "  %-10s %-55s   | %s", "", "spsc_ring", "block_linked_list");
+	cout << line << endl;
+	sprintf(line, "  %-10s %10s %10s %10s %10s %10s   | %10s %10s %10s %10s %10s", "operation",
+		"mean", "p50", "p99", "p99.9", "max", "mean", "p50", "p99", "p99.9", "max");
+	cout << line << endl;
+	printRow("push", ring->push, list->push);
+	printRow("consume", ring->consume, list->consume);
+	printRow("hand-over", ring->handOver, list->handOver);
+	printRow("clock", *clock, *clock);
+	cout << "Dropped: " << ring->dropped << " (spsc_ring), " << list->dropped << " (block_linked_list)" << endl;
+
+	delete clock;
+	delete list;
+	delete ring;
+	return 0;
+}
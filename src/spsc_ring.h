@@ -0,0 +1,121 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring buffer.
+//
+// This is the hand-over point between the haptic thread (the only caller
+// of try_push) and the flushing thread (the only caller of peek/pop).
+// The storage is allocated once in the constructor, so pushing never
+// allocates, never blocks and never takes a lock.  If the consumer falls
+// behind and the ring is full, try_push returns false and the sample is
+// counted in dropped() instead of stalling the real-time loop.
+//
+// head and tail are free-running counters; the slot of an index is
+// (index & (capacity - 1)), so capacity must be a power of two.  The
+// producer publishes a slot with a release store of tail and the consumer
+// frees it with a release store of head; each side reads the other
+// index with acquire semantics, which orders the slot accesses correctly
+// on weakly-ordered CPUs.
+template <class T, size_t capacity> class spsc_ring {
+	static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0,
+		"spsc_ring capacity must be a power of two");
+
+public:
+
+	spsc_ring() : head(0), tail(0), m_dropped(0), cached_head(0), cached_tail(0) {
+		data = new T[capacity];
+	}
+
+	~spsc_ring() {
+		delete[] data;
+	}
+
+	// Producer side.  Copies the element into the ring; returns false
+	// (and counts a dropped element) if the ring is full.
+	bool try_push(const T& in) {
+
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		if (t - cached_head == capacity) {
+			cached_head = head.load(std::memory_order_acquire);
+			if (t - cached_head == capacity) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+
+		data[t & (capacity - 1)] = in;
+		tail.store(t + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer side.  Points first at the oldest unread element and
+	// returns how many elements can be read contiguously from there
+	// (0 if the ring is empty).  The elements stay valid until pop().
+	size_t peek(T*& first) {
+
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if (cached_tail == h) {
+			cached_tail = tail.load(std::memory_order_acquire);
+			if (cached_tail == h) return 0;
+		}
+
+		size_t offset = h & (capacity - 1);
+		size_t count = cached_tail - h;
+		if (count > capacity - offset) count = capacity - offset;
+
+		first = data + offset;
+		return count;
+	}
+
+	// Consumer side.  Releases the first count elements returned by peek().
+	void pop(size_t count) {
+		head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// Approximate number of unread elements; exact when called from
+	// either the producer or the consumer thread.
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	// Number of elements rejected by try_push because the ring was full
+	size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	static size_t max_size() { return capacity; }
+
+private:
+
+	// Keep the indices on separate cache lines so the two threads do not
+	// invalidate each other's line on every push/pop
+	enum { cache_line = 64 };
+
+	T* data;
+	char pad0[cache_line];
+
+	// Written by the consumer only
+	std::atomic<size_t> head;
+	char pad1[cache_line - sizeof(std::atomic<size_t>)];
+
+	// Written by the producer only
+	std::atomic<size_t> tail;
+	std::atomic<size_t> m_dropped;
+	char pad2[cache_line - 2 * sizeof(std::atomic<size_t>)];
+
+	// Producer-private copy of head
+	size_t cached_head;
+	char pad3[cache_line - sizeof(size_t)];
+
+	// Consumer-private copy of tail
+	size_t cached_tail;
+
+	spsc_ring(const spsc_ring&);
+	spsc_ring& operator=(const spsc_ring&);
+};
+
+#endif